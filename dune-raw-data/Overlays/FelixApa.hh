@@ -0,0 +1,114 @@
+// FelixApa.hh
+// Assembly of the FELIX link fragments of an APA into one channel matrix.
+
+#ifndef artdaq_dune_Overlays_FelixApa_hh
+#define artdaq_dune_Overlays_FelixApa_hh
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "dune-raw-data/Overlays/FelixFormat.hh"
+#include "dune-raw-data/Overlays/FelixFragment.hh"
+#include "dune-raw-data/Overlays/FelixReorder.hh"
+#include "dune-raw-data/Overlays/FelixThreadPool.hh"
+
+namespace dune {
+
+// Decodes all FELIX link fragments of an event straight into a single
+// [offline channel][tick] matrix. The channel map is consulted once per link
+// (crate, slot, fiber) to build a permutation table from frame channel to
+// matrix row; after that, decoding a link is a tiled transpose into the
+// permuted rows, one task per link on the worker pool.
+class FelixApaAssembler {
+ public:
+  // Maps a frame channel (0-255) of the link with the given crate, slot and
+  // fiber numbers to an offline channel, e.g. by wrapping
+  // PdspChannelMapService::GetOfflineNumberFromDetectorElements.
+  typedef std::function<unsigned(unsigned crate, unsigned slot, unsigned fiber,
+                                 unsigned frame_channel)>
+      ChannelMapper;
+
+  // The matrix holds offline channels [first_channel,
+  // first_channel + num_channels); channels that map outside that range are
+  // not decoded. Decoding runs on the given pool, or on the pool of the
+  // shared FelixReorderEngine if none is given.
+  FelixApaAssembler(const ChannelMapper& mapper, const unsigned first_channel,
+                    const unsigned num_channels,
+                    FelixThreadPool* pool = nullptr)
+      : mapper_(mapper),
+        first_channel_(first_channel),
+        num_channels_(num_channels),
+        pool_(pool ? *pool : FelixReorderEngine::shared().pool()) {}
+
+  unsigned first_channel() const { return first_channel_; }
+  unsigned num_channels() const { return num_channels_; }
+
+  // Decodes all links into dst, where the ADC of offline channel c at tick t
+  // is dst[(c - first_channel())*stride + t]. stride must be at least the
+  // number of frames of the longest link. Rows that no link maps to are not
+  // written.
+  void assemble(const std::vector<FelixFragment>& links, adc_t* dst,
+                const size_t stride) {
+    // Look up permutation tables before going parallel.
+    std::vector<const std::vector<int>*> tables(links.size());
+    for (size_t l = 0; l < links.size(); ++l) {
+      tables[l] = links[l].total_frames() ? &table_(links[l]) : nullptr;
+    }
+    pool_.parallel_for(links.size(), [&](size_t l) {
+      if (!tables[l]) return;
+      adc_t* rows[FelixFrame::num_ch_per_frame];
+      for (unsigned ch = 0; ch < FelixFrame::num_ch_per_frame; ++ch) {
+        const int row = (*tables[l])[ch];
+        rows[ch] = row < 0 ? nullptr : dst + row * stride;
+      }
+      links[l].decode_rows(rows);
+    });
+  }
+
+  // Same, into a new zero-initialised matrix whose stride is the number of
+  // frames of the longest link.
+  adc_v assemble(const std::vector<FelixFragment>& links, size_t& stride) {
+    stride = 0;
+    for (const FelixFragment& link : links) {
+      stride = std::max(stride, link.total_frames());
+    }
+    adc_v matrix(num_channels_ * stride);
+    assemble(links, matrix.data(), stride);
+    return matrix;
+  }
+
+ private:
+  // Permutation table of the link: matrix row of every frame channel, or -1.
+  const std::vector<int>& table_(const FelixFragment& link) {
+    const unsigned crate = link.crate_no(0);
+    const unsigned slot = link.slot_no(0);
+    const unsigned fiber = link.fiber_no(0);
+    const uint32_t key = crate << 16 | slot << 8 | fiber;
+    auto it = tables_.find(key);
+    if (it != tables_.end()) return it->second;
+
+    std::vector<int> table(FelixFrame::num_ch_per_frame, -1);
+    for (unsigned ch = 0; ch < FelixFrame::num_ch_per_frame; ++ch) {
+      const unsigned offline = mapper_(crate, slot, fiber, ch);
+      if (offline >= first_channel_ &&
+          offline < first_channel_ + num_channels_) {
+        table[ch] = offline - first_channel_;
+      }
+    }
+    return tables_.emplace(key, std::move(table)).first->second;
+  }
+
+  ChannelMapper mapper_;
+  const unsigned first_channel_;
+  const unsigned num_channels_;
+  FelixThreadPool& pool_;
+  std::map<uint32_t, std::vector<int> > tables_;
+};
+
+}  // namespace dune
+
+#endif /* artdaq_dune_Overlays_FelixApa_hh */
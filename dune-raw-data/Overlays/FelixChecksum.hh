@@ -0,0 +1,166 @@
+// FelixChecksum.hh
+// Validation of the COLDATA block checksums of FELIX frames.
+
+#ifndef artdaq_dune_Overlays_FelixChecksum_hh
+#define artdaq_dune_Overlays_FelixChecksum_hh
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "dune-raw-data/Overlays/FelixCrc.hh"
+#include "dune-raw-data/Overlays/FelixDecode.hh"
+#include "dune-raw-data/Overlays/FelixFormat.hh"
+#include "dune-raw-data/Overlays/FelixFragment.hh"
+#include "dune-raw-data/Overlays/FelixReorder.hh"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace dune {
+
+// Byte layout of the packed ADC data of a COLDATA block within a frame.
+static constexpr size_t felix_coldata_adc_offset = sizeof(WIBHeader) +
+                                                    sizeof(ColdataHeader);
+static constexpr size_t felix_coldata_block_bytes = sizeof(ColdataBlock);
+static constexpr size_t felix_coldata_adc_bytes =
+    sizeof(ColdataBlock) - sizeof(ColdataHeader);
+
+// The checksum algorithm below has not been verified against real hardware
+// (see coldata_checksums()), so the validators are only compiled when
+// FELIX_UNVERIFIED_CHECKSUMS is defined before this header is included.
+#ifdef FELIX_UNVERIFIED_CHECKSUMS
+
+// Computes the two checksums of the packed ADC data of one COLDATA block
+// (96 bytes, read as 48 little-endian 16-bit words w[0..47]), Fletcher
+// style: a is the sum of the words and b the sum of the running sums of a,
+// i.e. the sum of (48 - k)*w[k], both modulo 2^16.
+//
+// NOTE: this algorithm is assumed, not taken from the COLDATA specification,
+// and has not been checked against checksums written by real hardware. The
+// CaptureChecksumTest unit test checks it against a WIB capture and is
+// reported as skipped when none is available. Until it passes there, keep
+// FELIX_UNVERIFIED_CHECKSUMS out of production builds.
+inline void coldata_checksums(const uint8_t* adcs, uint16_t& a, uint16_t& b) {
+  const size_t num_words = felix_coldata_adc_bytes / 2;
+#if defined(__SSE2__)
+  __m128i sum_a = _mm_setzero_si128();
+  __m128i sum_b = _mm_setzero_si128();
+  for (size_t k = 0; k < num_words; k += 8) {
+    const __m128i w =
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(adcs + 2 * k));
+    // madd works on signed words, which gives the same result mod 2^16.
+    const short c = num_words - k;
+    const __m128i weights =
+        _mm_setr_epi16(c, c - 1, c - 2, c - 3, c - 4, c - 5, c - 6, c - 7);
+    sum_a = _mm_add_epi16(sum_a, w);
+    sum_b = _mm_add_epi32(sum_b, _mm_madd_epi16(w, weights));
+  }
+  sum_a = _mm_add_epi16(sum_a, _mm_srli_si128(sum_a, 8));
+  sum_a = _mm_add_epi16(sum_a, _mm_srli_si128(sum_a, 4));
+  sum_a = _mm_add_epi16(sum_a, _mm_srli_si128(sum_a, 2));
+  sum_b = _mm_add_epi32(sum_b, _mm_srli_si128(sum_b, 8));
+  sum_b = _mm_add_epi32(sum_b, _mm_srli_si128(sum_b, 4));
+  a = _mm_cvtsi128_si32(sum_a);
+  b = _mm_cvtsi128_si32(sum_b);
+#else
+  uint16_t sa = 0, sb = 0;
+  for (size_t k = 0; k < num_words; ++k) {
+    sa += adcs[2 * k] | adcs[2 * k + 1] << 8;
+    sb += sa;
+  }
+  a = sa;
+  b = sb;
+#endif
+}
+
+// Frame visitor for decode_frames() that records the COLDATA blocks whose
+// checksums do not match their data: bit (first_frame + i)*4 + block of bad
+// is set for a bad block of frame i. Visitors that run concurrently must
+// cover groups of 16 frames so that they never share a bitmap word.
+class FelixChecksumValidator {
+ public:
+  FelixChecksumValidator(FelixFrameBitmap& bad, const size_t first_frame = 0)
+      : bad_(bad), first_frame_(first_frame) {}
+
+  void operator()(const size_t frame_ID, const FelixFrame& frame) const {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&frame);
+    for (unsigned b = 0; b < 4; ++b) {
+      uint16_t a, c;
+      coldata_checksums(bytes + felix_coldata_adc_offset +
+                            b * felix_coldata_block_bytes,
+                        a, c);
+      if (a != frame.checksum_a(b) || c != frame.checksum_b(b)) {
+        bad_.set((first_frame_ + frame_ID) * 4 + b);
+      }
+    }
+  }
+
+ private:
+  FelixFrameBitmap& bad_;
+  const size_t first_frame_;
+};
+
+// Checks the COLDATA checksums of all blocks of an array of frames (see the
+// note on coldata_checksums()). Returns a bitmap with one bit per block
+// (frame_ID*4 + block) that is set for blocks that do not match. Large
+// arrays are split over the given pool, or over the pool of the shared
+// FelixReorderEngine if none is given.
+inline FelixFrameBitmap validate_checksums(const FelixFrame* frames,
+                                           const size_t num_frames,
+                                           FelixThreadPool* pool = nullptr) {
+  FelixThreadPool& p = pool ? *pool : FelixReorderEngine::shared().pool();
+  FelixFrameBitmap bad(4 * num_frames);
+  const size_t num_tasks = std::max<size_t>(
+      1, std::min<size_t>(2 * p.size(),
+                          num_frames / FelixReorderer::min_frames_per_task));
+  const size_t frames_per_task =
+      ((num_frames + num_tasks - 1) / num_tasks + 15) / 16 * 16;
+  p.parallel_for(num_tasks, [&](size_t t) {
+    const FelixChecksumValidator validate(bad);
+    const size_t fr_end = std::min(num_frames, (t + 1) * frames_per_task);
+    for (size_t fr = t * frames_per_task; fr < fr_end; ++fr) {
+      validate(fr, frames[fr]);
+    }
+  });
+  return bad;
+}
+
+// Same for a fragment. Reordered fragments are restored to raw frames first,
+// and the frames of table-indexed ones are gathered.
+inline FelixFrameBitmap validate_checksums(const FelixFragment& fragment,
+                                           FelixThreadPool* pool = nullptr) {
+  if (fragment.contiguous()) {
+    return validate_checksums(static_cast<const FelixFrame*>(fragment.data()),
+                              fragment.total_frames(), pool);
+  }
+  if (!fragment.reordered()) {
+    const std::vector<FelixFrame> frames = gather_frames(fragment);
+    return validate_checksums(frames.data(), frames.size(), pool);
+  }
+  const uint8_t* data = static_cast<const uint8_t*>(fragment.data());
+  std::vector<FelixFrame> frames(
+      reinterpret_cast<const ReorderedFelixFrames*>(data)->total_frames());
+  FelixReorderEngine::shared().restore(
+      data, reinterpret_cast<uint8_t*>(frames.data()));
+  return validate_checksums(frames.data() + fragment.first_frame(),
+                            fragment.total_frames(), pool);
+}
+
+// Decodes frames like decode_frames() and checks their COLDATA checksums in
+// the same pass.
+inline FelixFrameBitmap decode_and_validate(const FelixFrame* frames,
+                                            const size_t num_frames,
+                                            adc_t* dst, const size_t stride) {
+  FelixFrameBitmap bad(4 * num_frames);
+  decode_frames(frames, num_frames, dst, stride, false,
+                FelixChecksumValidator(bad));
+  return bad;
+}
+
+#endif /* FELIX_UNVERIFIED_CHECKSUMS */
+
+}  // namespace dune
+
+#endif /* artdaq_dune_Overlays_FelixChecksum_hh */
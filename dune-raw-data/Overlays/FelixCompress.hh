@@ -0,0 +1,715 @@
+// FelixCompress.hh
+// Compact encodings of the ADC section of reordered FELIX fragments.
+
+#ifndef artdaq_dune_Overlays_FelixCompress_hh
+#define artdaq_dune_Overlays_FelixCompress_hh
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "artdaq-core/Data/Fragment.hh"
+#include "cetlib/exception.h"
+#include "dune-raw-data/Overlays/FelixFormat.hh"
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#endif
+
+namespace dune {
+
+//=========================================
+// Delta + Huffman codec for channel rows
+//=========================================
+// Every channel row is stored as the differences between consecutive ticks.
+// Differences in [-127, 127] are mapped to symbols 0..254 (zigzag order) and
+// Huffman coded with one code table per fragment; larger jumps, including
+// the first tick of each row, are coded as an escape symbol followed by the
+// raw 12-bit value. Each row starts at a recorded bit offset, so single
+// channels can be decoded without touching the rest of the section.
+//
+// Section layout:
+//   uint8_t code_lengths[256] | word_t row_bit_offset[257] | padding to 8 |
+//   bitstream (LSB-first) | 8 zero bytes
+class FelixDeltaHuffman {
+ public:
+  static const unsigned num_symbols = 256;
+  static const unsigned escape = 255;
+  static const unsigned max_code_length = 12;
+  static const int max_delta = 127;
+  static const unsigned num_rows = 256;
+
+  struct SectionHeader {
+    uint8_t code_lengths[num_symbols];
+    word_t row_bit_offset[num_rows + 1];
+  };
+  static const size_t bitstream_offset = (sizeof(SectionHeader) + 7) / 8 * 8;
+
+  // Encodes num_rows channel rows of num_frames values each, row ch starting
+  // at rows + ch*stride.
+  static std::vector<uint8_t> encode(const adc_t* rows, const size_t stride,
+                                     const size_t num_frames) {
+    // Symbol statistics over the whole fragment.
+    uint64_t freq[num_symbols] = {};
+    for (unsigned ch = 0; ch < num_rows; ++ch) {
+      const adc_t* row = rows + ch * stride;
+      int prev = 0;
+      for (size_t i = 0; i < num_frames; ++i) {
+        ++freq[symbol_(row[i] - prev)];
+        prev = row[i];
+      }
+    }
+
+    std::vector<uint8_t> out(bitstream_offset);
+    SectionHeader head;
+    code_lengths_(freq, head.code_lengths);
+    uint32_t codes[num_symbols];
+    reversed_codes_(head.code_lengths, codes);
+
+    // Bitstream.
+    uint64_t buf = 0;
+    unsigned nbits = 0;
+    size_t total_bits = 0;
+    auto put = [&](const uint32_t bits, const unsigned len) {
+      buf |= (uint64_t)bits << nbits;
+      nbits += len;
+      total_bits += len;
+      while (nbits >= 8) {
+        out.push_back(buf & 0xff);
+        buf >>= 8;
+        nbits -= 8;
+      }
+    };
+    for (unsigned ch = 0; ch < num_rows; ++ch) {
+      head.row_bit_offset[ch] = total_bits;
+      const adc_t* row = rows + ch * stride;
+      int prev = 0;
+      for (size_t i = 0; i < num_frames; ++i) {
+        const unsigned sym = symbol_(row[i] - prev);
+        put(codes[sym], head.code_lengths[sym]);
+        if (sym == escape) put(row[i] & 0xfff, 12);
+        prev = row[i];
+      }
+    }
+    head.row_bit_offset[num_rows] = total_bits;
+    if (nbits) out.push_back(buf & 0xff);
+    out.resize(out.size() + 8, 0);
+
+    memcpy(out.data(), &head, sizeof(head));
+    return out;
+  }
+
+  // Table-driven decoder for one encoded section.
+  class Decoder {
+   public:
+    Decoder() {}
+    explicit Decoder(const uint8_t* section) { init(section); }
+
+    void init(const uint8_t* section) {
+      section_ = section;
+      const SectionHeader* head =
+          reinterpret_cast<const SectionHeader*>(section);
+      uint32_t codes[num_symbols];
+      reversed_codes_(head->code_lengths, codes);
+      table_.assign(1u << max_code_length, 0);
+      for (unsigned sym = 0; sym < num_symbols; ++sym) {
+        const unsigned len = head->code_lengths[sym];
+        if (!len) continue;
+        for (uint32_t k = 0; k < (1u << (max_code_length - len)); ++k) {
+          table_[codes[sym] | (k << len)] = sym << 4 | len;
+        }
+      }
+    }
+    bool initialized() const { return section_ != nullptr; }
+
+    // Decodes num_frames values of channel row ch into out.
+    void decode_row(const unsigned ch, const size_t num_frames,
+                    adc_t* out) const {
+      const SectionHeader* head =
+          reinterpret_cast<const SectionHeader*>(section_);
+      const uint8_t* bits = section_ + bitstream_offset;
+      size_t pos = head->row_bit_offset[ch];
+      int prev = 0;
+      for (size_t i = 0; i < num_frames; ++i) {
+        uint64_t w;
+        memcpy(&w, bits + (pos >> 3), sizeof(w));
+        w >>= pos & 7;
+        const uint16_t e = table_[w & ((1u << max_code_length) - 1)];
+        const unsigned len = e & 0xf;
+        const unsigned sym = e >> 4;
+        pos += len;
+        if (sym == escape) {
+          prev = (w >> len) & 0xfff;
+          pos += 12;
+        } else {
+          prev += (sym & 1) ? -int(sym + 1) / 2 : int(sym / 2);
+        }
+        out[i] = prev;
+      }
+    }
+
+   private:
+    const uint8_t* section_ = nullptr;
+    std::vector<uint16_t> table_;
+  };
+
+ private:
+  static unsigned symbol_(const int delta) {
+    if (delta > max_delta || delta < -max_delta) return escape;
+    return delta >= 0 ? 2 * delta : -2 * delta - 1;
+  }
+
+  // Huffman code lengths, limited to max_code_length by repeatedly halving
+  // the symbol counts until the tree is shallow enough.
+  static void code_lengths_(const uint64_t* freq_in, uint8_t* lengths) {
+    std::vector<uint64_t> freq(freq_in, freq_in + num_symbols);
+    while (true) {
+      std::fill(lengths, lengths + num_symbols, 0);
+      typedef std::pair<uint64_t, int> node_t;
+      std::priority_queue<node_t, std::vector<node_t>, std::greater<node_t> >
+          queue;
+      std::vector<int> parent(2 * num_symbols, -1);
+      for (unsigned sym = 0; sym < num_symbols; ++sym) {
+        if (freq[sym]) queue.push(node_t(freq[sym], sym));
+      }
+      if (queue.empty()) return;
+      if (queue.size() == 1) {
+        lengths[queue.top().second] = 1;
+        return;
+      }
+      int next = num_symbols;
+      while (queue.size() > 1) {
+        const node_t a = queue.top();
+        queue.pop();
+        const node_t b = queue.top();
+        queue.pop();
+        parent[a.second] = parent[b.second] = next;
+        queue.push(node_t(a.first + b.first, next++));
+      }
+      unsigned longest = 0;
+      for (unsigned sym = 0; sym < num_symbols; ++sym) {
+        if (!freq[sym]) continue;
+        unsigned len = 0;
+        for (int n = sym; parent[n] >= 0; n = parent[n]) ++len;
+        lengths[sym] = len;
+        longest = std::max(longest, len);
+      }
+      if (longest <= max_code_length) return;
+      for (auto& f : freq) {
+        if (f) f = (f + 1) / 2;
+      }
+    }
+  }
+
+  // Canonical codes for the given lengths, bit-reversed for LSB-first
+  // streams.
+  static void reversed_codes_(const uint8_t* lengths, uint32_t* codes) {
+    uint32_t code = 0;
+    for (unsigned len = 1; len <= max_code_length; ++len) {
+      for (unsigned sym = 0; sym < num_symbols; ++sym) {
+        if (lengths[sym] != len) continue;
+        uint32_t rev = 0;
+        for (unsigned b = 0; b < len; ++b) {
+          rev |= ((code >> b) & 1) << (len - 1 - b);
+        }
+        codes[sym] = rev;
+        ++code;
+      }
+      code <<= 1;
+    }
+  }
+};
+
+//==============================
+// 12-bit packing of channel rows
+//==============================
+// Two 12-bit values v0, v1 share three bytes, v0 | v1 << 12 little-endian,
+// so value i of a row starts at byte i/2*3, shifted by four bits if i is
+// odd. Whole rows are converted eight (SSSE3) or sixteen (AVX2) values at a
+// time.
+class FelixPacked12 {
+ public:
+  // Bytes taken by n packed values.
+  static size_t bytes(const size_t n) { return (n + 1) / 2 * 3; }
+
+  // Value i of a packed row.
+  static adc_t value(const uint8_t* row, const size_t i) {
+    uint16_t w;
+    memcpy(&w, row + i / 2 * 3 + (i & 1), sizeof(w));
+    return (i & 1) ? w >> 4 : w & 0xfff;
+  }
+
+  // Packs n values into bytes(n) bytes. Only the low 12 bits of each value
+  // are kept; an odd count leaves the upper half of the last byte triplet
+  // zero.
+  static void pack(const adc_t* in, const size_t n, uint8_t* out) {
+    size_t i = 0;
+#if defined(__SSSE3__)
+    // Each 32-bit lane becomes v0 + 4096*v1, of which bytes 0-2 are kept.
+    // The 16-byte store overruns the 12 packed bytes, so stop four values
+    // early.
+    const __m128i mask = _mm_set1_epi16(0x0fff);
+    const __m128i mul = _mm_set1_epi32(0x10000001);
+    const __m128i shuf = _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14,
+                                       -1, -1, -1, -1);
+    for (; i + 12 <= n; i += 8) {
+      const __m128i x = _mm_and_si128(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i)), mask);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i / 2 * 3),
+                       _mm_shuffle_epi8(_mm_madd_epi16(x, mul), shuf));
+    }
+#endif
+    for (; i + 2 <= n; i += 2) {
+      const uint32_t w = (in[i] & 0xfff) | (in[i + 1] & 0xfff) << 12;
+      uint8_t* p = out + i / 2 * 3;
+      p[0] = w;
+      p[1] = w >> 8;
+      p[2] = w >> 16;
+    }
+    if (i < n) {
+      uint8_t* p = out + i / 2 * 3;
+      p[0] = in[i];
+      p[1] = (in[i] >> 8) & 0xf;
+      p[2] = 0;
+    }
+  }
+
+  // Unpacks n values from bytes(n) bytes.
+  static void unpack(const uint8_t* in, const size_t n, adc_t* out) {
+    size_t i = 0;
+#if defined(__AVX2__) || defined(__SSSE3__)
+    // Byte pairs (3k, 3k+1) and (3k+1, 3k+2) hold the even and the odd value
+    // of triplet k; odd values are shifted down by four bits.
+#if defined(__AVX2__)
+    const __m256i shuf = _mm256_setr_epi8(
+        0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11,
+        0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+    const __m256i even = _mm256_set1_epi32(0x00000fff);
+    const __m256i odd = _mm256_set1_epi32(0xffff0000);
+    // Both 16-byte loads stay within the 30 bytes of 20 values.
+    for (; i + 20 <= n; i += 16) {
+      const uint8_t* p = in + i / 2 * 3;
+      const __m256i x = _mm256_shuffle_epi8(
+          _mm256_inserti128_si256(
+              _mm256_castsi128_si256(
+                  _mm_loadu_si128(reinterpret_cast<const __m128i*>(p))),
+              _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 12)), 1),
+          shuf);
+      _mm256_storeu_si256(
+          reinterpret_cast<__m256i*>(out + i),
+          _mm256_or_si256(_mm256_and_si256(x, even),
+                          _mm256_and_si256(_mm256_srli_epi16(x, 4), odd)));
+    }
+#endif
+    const __m128i shuf8 =
+        _mm_setr_epi8(0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11);
+    const __m128i even8 = _mm_set1_epi32(0x00000fff);
+    const __m128i odd8 = _mm_set1_epi32(0xffff0000);
+    for (; i + 12 <= n; i += 8) {
+      const __m128i x = _mm_shuffle_epi8(
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i / 2 * 3)),
+          shuf8);
+      _mm_storeu_si128(
+          reinterpret_cast<__m128i*>(out + i),
+          _mm_or_si128(_mm_and_si128(x, even8),
+                       _mm_and_si128(_mm_srli_epi16(x, 4), odd8)));
+    }
+#endif
+    for (; i < n; ++i) out[i] = value(in, i);
+  }
+};
+
+//==========================================
+// Block-indexed frame of reference codec
+//==========================================
+// Every channel row is cut into blocks of block_ticks ticks that are coded
+// independently, so a range of ticks of a channel decodes only the blocks
+// that overlap it. A block stores its smallest value as reference and the
+// offsets from it in b bits each (patched frame of reference): b is chosen
+// per block to minimise the block size, and the few values whose offset
+// does not fit, e.g. the samples of a hit, are stored as exceptions with
+// their position.
+//
+// Section layout:
+//   SectionHeader | word_t block_offset[256*blocks_per_row + 1] | blocks |
+//   8 zero bytes
+// Block layout (offsets relative to the first block):
+//   uint16_t reference | uint8_t width | uint8_t num_exceptions |
+//   num_exceptions * (uint16_t position, uint16_t value) |
+//   offsets (LSB-first, width bits each)
+class FelixBlockFor {
+ public:
+  static const unsigned default_block_ticks = 512;
+  static const unsigned num_rows = 256;
+  static const unsigned max_exceptions = 255;
+
+  struct SectionHeader {
+    word_t block_ticks;
+    word_t blocks_per_row;
+  };
+
+  // Encodes num_rows channel rows of num_frames values each, row ch starting
+  // at rows + ch*stride.
+  static std::vector<uint8_t> encode(
+      const adc_t* rows, const size_t stride, const size_t num_frames,
+      const unsigned block_ticks = default_block_ticks) {
+    SectionHeader head;
+    head.block_ticks = block_ticks;
+    head.blocks_per_row = (num_frames + block_ticks - 1) / block_ticks;
+    const size_t num_blocks = num_rows * head.blocks_per_row;
+    std::vector<word_t> index(num_blocks + 1);
+    std::vector<uint8_t> blocks;
+    for (unsigned ch = 0; ch < num_rows; ++ch) {
+      for (size_t b = 0; b < head.blocks_per_row; ++b) {
+        index[ch * head.blocks_per_row + b] = blocks.size();
+        const size_t first = b * block_ticks;
+        encode_block_(rows + ch * stride + first,
+                      std::min<size_t>(block_ticks, num_frames - first),
+                      blocks);
+      }
+    }
+    index[num_blocks] = blocks.size();
+
+    std::vector<uint8_t> out(sizeof(head) + index.size() * sizeof(word_t));
+    memcpy(out.data(), &head, sizeof(head));
+    memcpy(out.data() + sizeof(head), index.data(),
+           index.size() * sizeof(word_t));
+    out.insert(out.end(), blocks.begin(), blocks.end());
+    out.resize(out.size() + 8, 0);
+    return out;
+  }
+
+  // Decodes values [first, first + n) of channel row ch of an encoded
+  // section into out, touching only the blocks that hold them.
+  static void decode_range(const uint8_t* section, const unsigned ch,
+                           const size_t first, const size_t n, adc_t* out) {
+    if (!n) return;
+    SectionHeader head;
+    memcpy(&head, section, sizeof(head));
+    const word_t* index = reinterpret_cast<const word_t*>(section +
+                                                          sizeof(head));
+    const uint8_t* blocks =
+        section + sizeof(head) +
+        (num_rows * head.blocks_per_row + 1) * sizeof(word_t);
+    const size_t end = first + n;
+    for (size_t b = first / head.block_ticks;
+         b * head.block_ticks < end; ++b) {
+      const size_t begin = b * head.block_ticks;
+      const size_t lo = std::max(first, begin);
+      const size_t hi = std::min(end, begin + head.block_ticks);
+      decode_block_(blocks + index[ch * head.blocks_per_row + b], lo - begin,
+                    hi - begin, out + (lo - first));
+    }
+  }
+
+ private:
+  static void encode_block_(const adc_t* in, const size_t n,
+                            std::vector<uint8_t>& out) {
+    const adc_t reference = *std::min_element(in, in + n);
+    // Number of values whose offset needs exactly k bits.
+    size_t needs[17] = {};
+    for (size_t i = 0; i < n; ++i) {
+      ++needs[32 - __builtin_clz(uint32_t(in[i] - reference) << 1 | 1) - 1];
+    }
+    // Smallest block for each width: packed offsets plus 4 bytes per value
+    // that needs more bits.
+    unsigned width = 16;
+    size_t best = size_t(-1);
+    size_t above = n;
+    for (unsigned w = 0; w <= 16; ++w) {
+      above -= needs[w];
+      const size_t bytes = (n * w + 7) / 8 + 4 * above;
+      if (above <= max_exceptions && bytes < best) {
+        best = bytes;
+        width = w;
+      }
+    }
+
+    std::vector<uint16_t> exceptions;
+    for (size_t i = 0; i < n; ++i) {
+      if (width < 16 && (in[i] - reference) >> width) {
+        exceptions.push_back(i);
+        exceptions.push_back(in[i]);
+      }
+    }
+    const size_t start = out.size();
+    out.resize(start + 4 + exceptions.size() * sizeof(uint16_t) +
+                   (n * width + 7) / 8,
+               0);
+    uint8_t* p = out.data() + start;
+    memcpy(p, &reference, sizeof(reference));
+    p[2] = width;
+    p[3] = exceptions.size() / 2;
+    memcpy(p + 4, exceptions.data(), exceptions.size() * sizeof(uint16_t));
+    uint8_t* bits = p + 4 + exceptions.size() * sizeof(uint16_t);
+    for (size_t i = 0; i < n; ++i) {
+      const size_t pos = i * width;
+      const uint32_t v =
+          (uint32_t(in[i] - reference) & ((1u << width) - 1)) << (pos & 7);
+      for (unsigned k = 0; k * 8 < width + (pos & 7); ++k) {
+        bits[pos / 8 + k] |= v >> (8 * k);
+      }
+    }
+  }
+
+  // Decodes values [from, to) of a block into out.
+  static void decode_block_(const uint8_t* block, const size_t from,
+                            const size_t to, adc_t* out) {
+    uint16_t reference;
+    memcpy(&reference, block, sizeof(reference));
+    const unsigned width = block[2];
+    const unsigned num_exceptions = block[3];
+    const uint8_t* exceptions = block + 4;
+    const uint8_t* bits = exceptions + 4 * num_exceptions;
+    const uint64_t mask = (uint64_t(1) << width) - 1;
+    // Offsets are at most 16 bits wide, so one 8-byte load always holds a
+    // whole one; the section ends in padding for the last loads.
+    for (size_t i = from; i < to; ++i) {
+      const size_t pos = i * width;
+      uint64_t w;
+      memcpy(&w, bits + pos / 8, sizeof(w));
+      out[i - from] = reference + ((w >> (pos & 7)) & mask);
+    }
+    // Exceptions are sorted by position.
+    for (unsigned k = 0; k < num_exceptions; ++k) {
+      uint16_t pair[2];
+      memcpy(pair, exceptions + 4 * k, sizeof(pair));
+      if (pair[0] >= to) break;
+      if (pair[0] >= from) out[pair[0] - from] = pair[1];
+    }
+  }
+};
+
+//=====================
+// Channel row decoder
+//=====================
+// Decodes single channel rows of a reordered fragment, whatever the encoding
+// of its ADC section.
+class FelixRowDecoder {
+ public:
+  FelixRowDecoder() {}
+  explicit FelixRowDecoder(const ReorderedFelixFrames* frames) {
+    init(frames);
+  }
+
+  // Throws for ADC encodings it does not know.
+  void init(const ReorderedFelixFrames* frames) {
+    frames_ = frames;
+    switch (encoding()) {
+      case ReorderedFelixFrames::adc_raw16:
+      case ReorderedFelixFrames::adc_packed12:
+      case ReorderedFelixFrames::adc_block_for:
+        break;
+      case ReorderedFelixFrames::adc_delta_huffman:
+        huffman_.init(frames->adc_section());
+        break;
+      default:
+        frames_ = nullptr;
+        unknown_encoding_(frames->header().adc_encoding);
+    }
+  }
+  bool initialized() const { return frames_ != nullptr; }
+  word_t encoding() const { return frames_->header().adc_encoding; }
+
+  // Decodes the first num_frames values of channel row ch into out.
+  void decode_row(const unsigned ch, const size_t num_frames,
+                  adc_t* out) const {
+    switch (encoding()) {
+      case ReorderedFelixFrames::adc_raw16:
+        memcpy(out, frames_->channel_row(ch), num_frames * sizeof(adc_t));
+        break;
+      case ReorderedFelixFrames::adc_packed12:
+        FelixPacked12::unpack(frames_->packed_row(ch), num_frames, out);
+        break;
+      case ReorderedFelixFrames::adc_delta_huffman:
+        huffman_.decode_row(ch, num_frames, out);
+        break;
+      case ReorderedFelixFrames::adc_block_for:
+        FelixBlockFor::decode_range(frames_->adc_section(), ch, 0, num_frames,
+                                    out);
+        break;
+      default:
+        unknown_encoding_(encoding());
+    }
+  }
+
+  // Decodes values [first, first + n) of channel row ch into out. The delta
+  // codec has to decode the row from its start; the others go straight to
+  // the requested values.
+  void decode_range(const unsigned ch, const size_t first, const size_t n,
+                    adc_t* out) const {
+    switch (encoding()) {
+      case ReorderedFelixFrames::adc_raw16:
+        memcpy(out, frames_->channel_row(ch) + first, n * sizeof(adc_t));
+        break;
+      case ReorderedFelixFrames::adc_packed12: {
+        const uint8_t* row = frames_->packed_row(ch);
+        for (size_t i = 0; i < n; ++i) {
+          out[i] = FelixPacked12::value(row, first + i);
+        }
+        break;
+      }
+      case ReorderedFelixFrames::adc_delta_huffman: {
+        if (first == 0) {
+          huffman_.decode_row(ch, n, out);
+          break;
+        }
+        adc_v row(first + n);
+        huffman_.decode_row(ch, first + n, row.data());
+        std::copy(row.begin() + first, row.end(), out);
+        break;
+      }
+      case ReorderedFelixFrames::adc_block_for:
+        FelixBlockFor::decode_range(frames_->adc_section(), ch, first, n, out);
+        break;
+      default:
+        unknown_encoding_(encoding());
+    }
+  }
+
+ private:
+  static void unknown_encoding_(const word_t encoding) {
+    throw cet::exception("FelixRowDecoder")
+        << "Unknown ADC encoding " << encoding << ".";
+  }
+
+  const ReorderedFelixFrames* frames_ = nullptr;
+  FelixDeltaHuffman::Decoder huffman_;
+};
+
+// Channel-major rows of a reordered fragment in any encoding: the rows of
+// adc_raw16 data are used in place, others are decoded into a buffer.
+class FelixDecodedRows {
+ public:
+  explicit FelixDecodedRows(const ReorderedFelixFrames* frames) {
+    const ReorderedFelixFrames::Header& h = frames->header();
+    if (h.adc_encoding == ReorderedFelixFrames::adc_raw16) {
+      rows_ = frames->channel_row(0);
+      stride_ = h.adc_row_stride;
+      return;
+    }
+    const FelixRowDecoder decoder(frames);
+    buffer_.resize(h.num_frames * FelixFrame::num_ch_per_frame);
+    for (unsigned ch = 0; ch < FelixFrame::num_ch_per_frame; ++ch) {
+      decoder.decode_row(ch, h.num_frames, buffer_.data() + ch * h.num_frames);
+    }
+    rows_ = buffer_.data();
+    stride_ = h.num_frames;
+  }
+
+  const adc_t* rows() const { return rows_; }
+  size_t stride() const { return stride_; }
+
+ private:
+  const adc_t* rows_;
+  size_t stride_;
+  adc_v buffer_;
+};
+
+// Re-encodes the ADC section of a reordered fragment (see FelixReorder())
+// in a compact encoding. All header sections are kept as they are.
+inline artdaq::Fragment FelixEncode(
+    const artdaq::Fragment& reordered,
+    const ReorderedFelixFrames::AdcEncoding encoding) {
+  const ReorderedFelixFrames* frames =
+      reinterpret_cast<const ReorderedFelixFrames*>(reordered.dataBeginBytes());
+  frames->validate();
+  ReorderedFelixFrames::Header head = frames->header();
+  const FelixDecodedRows rows(frames);
+  std::vector<uint8_t> section;
+  if (encoding == ReorderedFelixFrames::adc_delta_huffman) {
+    section = FelixDeltaHuffman::encode(rows.rows(), rows.stride(),
+                                        head.num_frames);
+  } else if (encoding == ReorderedFelixFrames::adc_block_for) {
+    section = FelixBlockFor::encode(rows.rows(), rows.stride(),
+                                    head.num_frames);
+  } else if (encoding == ReorderedFelixFrames::adc_packed12) {
+    const size_t row_bytes =
+        ReorderedFelixFrames::packed_row_bytes(head.adc_row_stride);
+    section.assign(FelixFrame::num_ch_per_frame * row_bytes, 0);
+    for (unsigned ch = 0; ch < FelixFrame::num_ch_per_frame; ++ch) {
+      FelixPacked12::pack(rows.rows() + ch * rows.stride(), head.num_frames,
+                          section.data() + ch * row_bytes);
+    }
+  } else {
+    const size_t row_bytes = head.adc_row_stride * sizeof(adc_t);
+    section.assign(FelixFrame::num_ch_per_frame * row_bytes, 0);
+    for (unsigned ch = 0; ch < FelixFrame::num_ch_per_frame; ++ch) {
+      memcpy(section.data() + ch * row_bytes, rows.rows() + ch * rows.stride(),
+             head.num_frames * sizeof(adc_t));
+    }
+  }
+
+  head.version = ReorderedFelixFrames::format_version;
+  head.adc_encoding = encoding;
+  head.adc_bytes = section.size();
+
+  artdaq::Fragment result;
+  result.resizeBytes(ReorderedFelixFrames::size_bytes(head));
+  memcpy(result.dataBeginBytes(), reordered.dataBeginBytes(), head.adc_offset);
+  memcpy(result.dataBeginBytes(), &head, sizeof(head));
+  memcpy(result.dataBeginBytes() + head.adc_offset, section.data(),
+         section.size());
+  return result;
+}
+
+// Compresses the ADC section of a reordered fragment with the delta +
+// Huffman codec.
+inline artdaq::Fragment FelixCompress(const artdaq::Fragment& reordered) {
+  return FelixEncode(reordered, ReorderedFelixFrames::adc_delta_huffman);
+}
+
+// Replaces the WIB and COLDATA header sections of a reordered fragment by
+// compact header columns (see FelixHeaderColumns). The CRC32 and ADC
+// sections are kept as they are, so this combines with any ADC encoding.
+inline artdaq::Fragment FelixCompactHeaders(const artdaq::Fragment& reordered) {
+  const ReorderedFelixFrames* frames =
+      reinterpret_cast<const ReorderedFelixFrames*>(reordered.dataBeginBytes());
+  frames->validate();
+  const ReorderedFelixFrames::Header& head = frames->header();
+  if (head.header_encoding == ReorderedFelixFrames::headers_compact) {
+    return reordered;
+  }
+  typedef FelixHeaderColumns C;
+  const size_t num_frames = head.num_frames;
+  std::vector<uint64_t> values(C::num_columns * num_frames);
+  for (size_t i = 0; i < num_frames; ++i) {
+    ColdataHeader blocks[C::num_blocks];
+    for (unsigned b = 0; b < C::num_blocks; ++b) {
+      blocks[b] = frames->coldata_header(i, b);
+    }
+    uint64_t v[C::num_columns];
+    C::split(frames->wib_header(i), blocks, v);
+    for (unsigned c = 0; c < C::num_columns; ++c) {
+      values[c * num_frames + i] = v[c];
+    }
+  }
+  const std::vector<uint8_t> columns = C::encode(values.data(), num_frames);
+
+  ReorderedFelixFrames::Header compact = head;
+  compact.version = ReorderedFelixFrames::format_version;
+  compact.header_encoding = ReorderedFelixFrames::headers_compact;
+  compact.coldata_headers_offset = head.wib_headers_offset;
+  compact.crc32_offset = head.wib_headers_offset + columns.size();
+  compact.adc_offset =
+      (compact.crc32_offset + num_frames * sizeof(word_t) + 63) / 64 * 64;
+
+  artdaq::Fragment result;
+  result.resizeBytes(ReorderedFelixFrames::size_bytes(compact));
+  uint8_t* dest = result.dataBeginBytes();
+  const uint8_t* src = reordered.dataBeginBytes();
+  memset(dest, 0, compact.adc_offset);
+  memcpy(dest, &compact, sizeof(compact));
+  memcpy(dest + compact.wib_headers_offset, columns.data(), columns.size());
+  memcpy(dest + compact.crc32_offset, src + head.crc32_offset,
+         num_frames * sizeof(word_t));
+  memcpy(dest + compact.adc_offset, src + head.adc_offset, head.adc_bytes);
+  return result;
+}
+
+}  // namespace dune
+
+#endif /* artdaq_dune_Overlays_FelixCompress_hh */
@@ -0,0 +1,187 @@
+// FelixCrc.hh
+// Batch verification of the CRC32 words of FELIX frames.
+
+#ifndef artdaq_dune_Overlays_FelixCrc_hh
+#define artdaq_dune_Overlays_FelixCrc_hh
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "dune-raw-data/Overlays/FelixFormat.hh"
+#include "dune-raw-data/Overlays/FelixFragment.hh"
+#include "dune-raw-data/Overlays/FelixReorder.hh"
+#include "dune-raw-data/Overlays/FelixThreadPool.hh"
+
+#if defined(__SSE4_2__)
+#include <nmmintrin.h>
+#endif
+
+namespace dune {
+
+//====================
+// Per-frame bitmap
+//====================
+// One bit per frame of a fragment, e.g. the frames that failed a check.
+class FelixFrameBitmap {
+ public:
+  explicit FelixFrameBitmap(const size_t num_frames = 0)
+      : words_((num_frames + 63) / 64, 0), size_(num_frames) {}
+
+  size_t size() const { return size_; }
+  bool test(const size_t frame_ID) const {
+    return words_[frame_ID / 64] >> (frame_ID % 64) & 1;
+  }
+  void set(const size_t frame_ID) {
+    words_[frame_ID / 64] |= uint64_t(1) << (frame_ID % 64);
+  }
+  // Number of frames whose bit is set.
+  size_t count() const {
+    size_t n = 0;
+    for (uint64_t w : words_) n += __builtin_popcountll(w);
+    return n;
+  }
+  bool none() const { return count() == 0; }
+
+  // Underlying 64-frame words. Different words may be written concurrently.
+  uint64_t* words() { return words_.data(); }
+  const uint64_t* words() const { return words_.data(); }
+
+ private:
+  std::vector<uint64_t> words_;
+  size_t size_;
+};
+
+//================
+// CRC32 computer
+//================
+// Table-driven CRC-32 for a reflected polynomial, processing eight bytes per
+// step (slicing-by-8). The register starts at 0xFFFFFFFF and is inverted at
+// the end, as in IEEE 802.3. With the Castagnoli polynomial the SSE4.2 CRC32
+// instruction is used when available.
+class FelixCrc32 {
+ public:
+  static constexpr uint32_t ieee_polynomial = 0xEDB88320;
+  static constexpr uint32_t castagnoli_polynomial = 0x82F63B78;
+
+  explicit FelixCrc32(const uint32_t polynomial = ieee_polynomial)
+      : polynomial_(polynomial) {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t c = i;
+      for (unsigned k = 0; k < 8; ++k) c = (c >> 1) ^ (c & 1 ? polynomial : 0);
+      table_[0][i] = c;
+    }
+    for (unsigned t = 1; t < 8; ++t) {
+      for (uint32_t i = 0; i < 256; ++i) {
+        table_[t][i] =
+            (table_[t - 1][i] >> 8) ^ table_[0][table_[t - 1][i] & 0xff];
+      }
+    }
+  }
+
+  uint32_t polynomial() const { return polynomial_; }
+
+  uint32_t operator()(const void* data, size_t len) const {
+    const uint8_t* p = static_cast<const uint8_t*>(data);
+    uint32_t crc = 0xFFFFFFFF;
+#if defined(__SSE4_2__) && defined(__x86_64__)
+    if (polynomial_ == castagnoli_polynomial) {
+      uint64_t c = crc;
+      for (; len >= 8; len -= 8, p += 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        c = _mm_crc32_u64(c, w);
+      }
+      crc = c;
+      for (; len; --len) crc = _mm_crc32_u8(crc, *p++);
+      return ~crc;
+    }
+#endif
+    for (; len >= 8; len -= 8, p += 8) {
+      uint64_t w;
+      memcpy(&w, p, sizeof(w));
+      w ^= crc;
+      crc = table_[7][w & 0xff] ^ table_[6][(w >> 8) & 0xff] ^
+            table_[5][(w >> 16) & 0xff] ^ table_[4][(w >> 24) & 0xff] ^
+            table_[3][(w >> 32) & 0xff] ^ table_[2][(w >> 40) & 0xff] ^
+            table_[1][(w >> 48) & 0xff] ^ table_[0][w >> 56];
+    }
+    for (; len; --len) crc = table_[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+  }
+
+  // The CRC of a frame covers everything but the CRC word itself.
+  uint32_t frame_crc(const FelixFrame& frame) const {
+    return (*this)(&frame, sizeof(FelixFrame) - sizeof(word_t));
+  }
+
+ private:
+  uint32_t polynomial_;
+  uint32_t table_[8][256];
+};
+
+// Shared IEEE table, built once on first use.
+inline const FelixCrc32& felix_crc32() {
+  static const FelixCrc32 crc;
+  return crc;
+}
+
+// Returns the frames of an array whose CRC32 word does not match their
+// contents. Large arrays are split over the given pool, or over the pool of
+// the shared FelixReorderEngine if none is given.
+inline FelixFrameBitmap verify_crc(const FelixFrame* frames,
+                                   const size_t num_frames,
+                                   const FelixCrc32& crc = felix_crc32(),
+                                   FelixThreadPool* pool = nullptr) {
+  FelixThreadPool& p = pool ? *pool : FelixReorderEngine::shared().pool();
+  FelixFrameBitmap bad(num_frames);
+  // Tasks cover whole bitmap words, so they never share one.
+  const size_t num_words = (num_frames + 63) / 64;
+  const size_t num_tasks = std::max<size_t>(
+      1, std::min<size_t>(2 * p.size(),
+                          num_frames / FelixReorderer::min_frames_per_task));
+  const size_t words_per_task = (num_words + num_tasks - 1) / num_tasks;
+  uint64_t* words = bad.words();
+  p.parallel_for(num_tasks, [&](size_t t) {
+    const size_t w_end = std::min(num_words, (t + 1) * words_per_task);
+    for (size_t w = t * words_per_task; w < w_end; ++w) {
+      const size_t fr_end = std::min(num_frames, (w + 1) * 64);
+      uint64_t mask = 0;
+      for (size_t fr = w * 64; fr < fr_end; ++fr) {
+        if (crc.frame_crc(frames[fr]) != frames[fr].CRC32()) {
+          mask |= uint64_t(1) << (fr % 64);
+        }
+      }
+      words[w] = mask;
+    }
+  });
+  return bad;
+}
+
+// Returns the frames of a fragment whose CRC32 word does not match their
+// contents. Reordered fragments are restored to raw frames first, and the
+// frames of table-indexed ones are gathered.
+inline FelixFrameBitmap verify_crc(const FelixFragment& fragment,
+                                   const FelixCrc32& crc = felix_crc32(),
+                                   FelixThreadPool* pool = nullptr) {
+  if (fragment.contiguous()) {
+    return verify_crc(static_cast<const FelixFrame*>(fragment.data()),
+                      fragment.total_frames(), crc, pool);
+  }
+  if (!fragment.reordered()) {
+    const std::vector<FelixFrame> frames = gather_frames(fragment);
+    return verify_crc(frames.data(), frames.size(), crc, pool);
+  }
+  const uint8_t* data = static_cast<const uint8_t*>(fragment.data());
+  std::vector<FelixFrame> frames(
+      reinterpret_cast<const ReorderedFelixFrames*>(data)->total_frames());
+  FelixReorderEngine::shared().restore(
+      data, reinterpret_cast<uint8_t*>(frames.data()));
+  return verify_crc(frames.data() + fragment.first_frame(),
+                    fragment.total_frames(), crc, pool);
+}
+
+}  // namespace dune
+
+#endif /* artdaq_dune_Overlays_FelixCrc_hh */
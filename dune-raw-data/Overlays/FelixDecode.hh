@@ -0,0 +1,279 @@
+// FelixDecode.hh
+// Bulk decoding of FELIX frame arrays into channel-major ADC matrices.
+
+#ifndef artdaq_dune_Overlays_FelixDecode_hh
+#define artdaq_dune_Overlays_FelixDecode_hh
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "dune-raw-data/Overlays/FelixFormat.hh"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace dune {
+
+// Number of frames decoded into a tile before it is transposed into the
+// destination. 32 frames give one full cache line per channel row, and the
+// 16 KB tile stays in L1.
+static constexpr size_t felix_decode_tile_frames = 32;
+// Tile length used with streaming stores. Each channel row then receives
+// four whole cache lines per tile, which keeps write combining efficient.
+// The 64 KB tile is larger than L1 and is served from L2.
+static constexpr size_t felix_stream_tile_frames = 128;
+
+// Transposes an 8x8 block of 16-bit values: row i of src (src + i*src_stride)
+// becomes column i of dst (dst + j*dst_stride for row j).
+inline void transpose_8x8(const adc_t* src, const size_t src_stride,
+                          adc_t* dst, const size_t dst_stride) {
+#if defined(__SSE2__)
+  __m128i r[8];
+  for (unsigned i = 0; i < 8; ++i) {
+    r[i] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * src_stride));
+  }
+  const __m128i a0 = _mm_unpacklo_epi16(r[0], r[1]);
+  const __m128i a1 = _mm_unpackhi_epi16(r[0], r[1]);
+  const __m128i a2 = _mm_unpacklo_epi16(r[2], r[3]);
+  const __m128i a3 = _mm_unpackhi_epi16(r[2], r[3]);
+  const __m128i a4 = _mm_unpacklo_epi16(r[4], r[5]);
+  const __m128i a5 = _mm_unpackhi_epi16(r[4], r[5]);
+  const __m128i a6 = _mm_unpacklo_epi16(r[6], r[7]);
+  const __m128i a7 = _mm_unpackhi_epi16(r[6], r[7]);
+  const __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+  const __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+  const __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+  const __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+  const __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+  const __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+  const __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+  const __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+  r[0] = _mm_unpacklo_epi64(b0, b4);
+  r[1] = _mm_unpackhi_epi64(b0, b4);
+  r[2] = _mm_unpacklo_epi64(b1, b5);
+  r[3] = _mm_unpackhi_epi64(b1, b5);
+  r[4] = _mm_unpacklo_epi64(b2, b6);
+  r[5] = _mm_unpackhi_epi64(b2, b6);
+  r[6] = _mm_unpacklo_epi64(b3, b7);
+  r[7] = _mm_unpackhi_epi64(b3, b7);
+  for (unsigned j = 0; j < 8; ++j) {
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + j * dst_stride), r[j]);
+  }
+#else
+  for (unsigned i = 0; i < 8; ++i) {
+    for (unsigned j = 0; j < 8; ++j) {
+      dst[j * dst_stride + i] = src[i * src_stride + j];
+    }
+  }
+#endif
+}
+
+// Transposes a tile of num_frames decoded frames (frame-major, 256 values per
+// frame) into the channel-major destination, where channel ch of tick fr
+// lives at dst[ch*stride + fr].
+inline void transpose_tile(const adc_t* tile, const size_t num_frames,
+                           adc_t* dst, const size_t stride) {
+  const size_t nch = FelixFrame::num_ch_per_frame;
+  const size_t full = num_frames - num_frames % 8;
+  for (size_t ch = 0; ch < nch; ch += 8) {
+    for (size_t fr = 0; fr < full; fr += 8) {
+      transpose_8x8(tile + fr * nch + ch, nch, dst + ch * stride + fr, stride);
+    }
+    for (size_t fr = full; fr < num_frames; ++fr) {
+      for (size_t c = ch; c < ch + 8; ++c) {
+        dst[c * stride + fr] = tile[fr * nch + c];
+      }
+    }
+  }
+}
+
+#if defined(__SSE2__)
+// Same as transpose_tile for a full streaming tile, but writes the
+// destination with streaming stores. Eight channel rows are first transposed
+// into a small L1 buffer and then written out one whole row segment at a
+// time, so that the write-combining buffers are always flushed full. The rows
+// of dst must be 64-byte aligned.
+inline void transpose_tile_stream(const adc_t* tile, adc_t* dst,
+                                  const size_t stride) {
+  const size_t nch = FelixFrame::num_ch_per_frame;
+  const size_t nfr = felix_stream_tile_frames;
+  alignas(64) adc_t rows[8 * nfr];
+  for (size_t ch = 0; ch < nch; ch += 8) {
+    for (size_t fr = 0; fr < nfr; fr += 8) {
+      transpose_8x8(tile + fr * nch + ch, nch, rows + fr, nfr);
+    }
+    for (size_t j = 0; j < 8; ++j) {
+      __m128i* out = reinterpret_cast<__m128i*>(dst + (ch + j) * stride);
+      const __m128i* in = reinterpret_cast<const __m128i*>(rows + j * nfr);
+      for (size_t k = 0; k < nfr / 8; ++k) {
+        _mm_stream_si128(out + k, _mm_load_si128(in + k));
+      }
+    }
+  }
+}
+#endif
+
+// Decodes frames in tiles of TileFrames frames and transposes each tile into
+// dst. Whole tiles are written with streaming stores if stream is set, which
+// needs TileFrames == felix_stream_tile_frames and 64-byte aligned rows.
+// Frame i is visited as first_ID + i.
+template <size_t TileFrames, typename Visitor>
+inline void decode_frame_tiles(const FelixFrame* frames,
+                               const size_t num_frames, adc_t* dst,
+                               const size_t stride, const bool stream,
+                               Visitor& visit, const size_t first_ID = 0) {
+  const size_t nch = FelixFrame::num_ch_per_frame;
+  alignas(64) adc_t tile[TileFrames * FelixFrame::num_ch_per_frame];
+  for (size_t fr0 = 0; fr0 < num_frames; fr0 += TileFrames) {
+    const size_t n =
+        (num_frames - fr0 < TileFrames) ? num_frames - fr0 : TileFrames;
+    for (size_t i = 0; i < n; ++i) {
+      frames[fr0 + i].unpack_all(tile + i * nch);
+      visit(first_ID + fr0 + i, frames[fr0 + i]);
+    }
+#if defined(__SSE2__)
+    if (stream && TileFrames == felix_stream_tile_frames && n == TileFrames) {
+      transpose_tile_stream(tile, dst + fr0, stride);
+      continue;
+    }
+#else
+    (void)stream;
+#endif
+    transpose_tile(tile, n, dst + fr0, stride);
+  }
+}
+
+// Decodes num_frames consecutive FELIX frames into a dense channel-major
+// matrix: dst[ch*stride + fr] = frames[fr].channel(ch). Every frame is read
+// exactly once; frames are unpacked in tiles that are then transposed so
+// that writes to each channel row are contiguous.
+//
+// If non_temporal is set, the output is written with streaming stores. Use
+// this when dst is much larger than the cache and will not be read back
+// soon, e.g. when reordering. The stride must be a multiple of 32 values so
+// that all rows share the alignment of dst. The ticks before the first
+// 64-byte boundary of a row are written with plain stores and the rest is
+// streamed, whatever the alignment of dst.
+//
+// visit(i, frames[i]) is called for every frame right after it has been
+// unpacked, while the frame is still in cache, so per-frame checks can ride
+// along with the decode at almost no cost.
+template <typename Visitor>
+inline void decode_frames(const FelixFrame* frames, const size_t num_frames,
+                          adc_t* dst, const size_t stride,
+                          const bool non_temporal, Visitor&& visit) {
+#if defined(__SSE2__)
+  if (non_temporal && stride % 32 == 0) {
+    const size_t misalignment = reinterpret_cast<uintptr_t>(dst) % 64;
+    const size_t head = std::min<size_t>(
+        num_frames, (64 - misalignment) % 64 / sizeof(adc_t));
+    decode_frame_tiles<felix_decode_tile_frames>(frames, head, dst, stride,
+                                                 false, visit);
+    decode_frame_tiles<felix_stream_tile_frames>(
+        frames + head, num_frames - head, dst + head, stride, true, visit,
+        head);
+    _mm_sfence();
+    return;
+  }
+#else
+  (void)non_temporal;
+#endif
+  decode_frame_tiles<felix_decode_tile_frames>(frames, num_frames, dst,
+                                               stride, false, visit);
+}
+
+// Frame visitor that does nothing.
+struct FelixNoVisitor {
+  void operator()(const size_t, const FelixFrame&) const {}
+};
+
+inline void decode_frames(const FelixFrame* frames, const size_t num_frames,
+                          adc_t* dst, const size_t stride,
+                          const bool non_temporal = false) {
+  decode_frames(frames, num_frames, dst, stride, non_temporal,
+                FelixNoVisitor());
+}
+
+// Decodes num_frames consecutive frames into separately placed channel rows:
+// rows[ch][fr] = frames[fr].channel(ch). The rows can lie anywhere, e.g. in
+// offline channel order; channels whose row is null are skipped. Each tile
+// is transposed eight channels at a time into a small L1 buffer and then
+// copied row by row.
+inline void decode_frames_to_rows(const FelixFrame* frames,
+                                  const size_t num_frames,
+                                  adc_t* const* rows) {
+  const size_t nch = FelixFrame::num_ch_per_frame;
+  const size_t tile_frames = felix_decode_tile_frames;
+  alignas(64) adc_t tile[felix_decode_tile_frames * nch];
+  alignas(64) adc_t staged[8 * felix_decode_tile_frames];
+  for (size_t fr0 = 0; fr0 < num_frames; fr0 += tile_frames) {
+    const size_t n =
+        (num_frames - fr0 < tile_frames) ? num_frames - fr0 : tile_frames;
+    for (size_t i = 0; i < n; ++i) {
+      frames[fr0 + i].unpack_all(tile + i * nch);
+    }
+    const size_t full = n - n % 8;
+    for (size_t ch = 0; ch < nch; ch += 8) {
+      for (size_t fr = 0; fr < full; fr += 8) {
+        transpose_8x8(tile + fr * nch + ch, nch, staged + fr, tile_frames);
+      }
+      for (size_t fr = full; fr < n; ++fr) {
+        for (size_t j = 0; j < 8; ++j) {
+          staged[j * tile_frames + fr] = tile[fr * nch + ch + j];
+        }
+      }
+      for (size_t j = 0; j < 8; ++j) {
+        if (rows[ch + j]) {
+          memcpy(rows[ch + j] + fr0, staged + j * tile_frames,
+                 n * sizeof(adc_t));
+        }
+      }
+    }
+  }
+}
+
+// Inverse of transpose_tile: gathers num_frames ticks of the channel-major
+// matrix src (src[ch*stride + fr]) into a frame-major tile of 256 values per
+// frame.
+inline void gather_tile(const adc_t* src, const size_t stride,
+                        const size_t num_frames, adc_t* tile) {
+  const size_t nch = FelixFrame::num_ch_per_frame;
+  const size_t full = num_frames - num_frames % 8;
+  for (size_t ch = 0; ch < nch; ch += 8) {
+    const adc_t* rows = src + ch * stride;
+    for (size_t fr = 0; fr < full; fr += 8) {
+      transpose_8x8(rows + fr, stride, tile + fr * nch + ch, nch);
+    }
+    for (size_t fr = full; fr < num_frames; ++fr) {
+      for (size_t c = 0; c < 8; ++c) {
+        tile[fr * nch + ch + c] = rows[c * stride + fr];
+      }
+    }
+  }
+}
+
+// Inverse of decode_frames: packs the channel-major matrix src
+// (src[ch*stride + fr]) into the ADC bits of num_frames consecutive frames.
+// The WIB and COLDATA headers and the CRC words of the frames are not
+// touched.
+inline void pack_frames(const adc_t* src, const size_t stride,
+                        const size_t num_frames, FelixFrame* frames) {
+  const size_t nch = FelixFrame::num_ch_per_frame;
+  const size_t tile_frames = felix_decode_tile_frames;
+  alignas(64) adc_t tile[felix_decode_tile_frames * nch];
+  for (size_t fr0 = 0; fr0 < num_frames; fr0 += tile_frames) {
+    const size_t n =
+        (num_frames - fr0 < tile_frames) ? num_frames - fr0 : tile_frames;
+    gather_tile(src + fr0, stride, n, tile);
+    for (size_t i = 0; i < n; ++i) {
+      frames[fr0 + i].pack_all(tile + i * nch);
+    }
+  }
+}
+
+}  // namespace dune
+
+#endif /* artdaq_dune_Overlays_FelixDecode_hh */
@@ -0,0 +1,121 @@
+// FelixFile.hh
+// Memory-mapped access to FELIX frame capture files.
+
+#ifndef artdaq_dune_Overlays_FelixFile_hh
+#define artdaq_dune_Overlays_FelixFile_hh
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <string>
+
+#include "cetlib/exception.h"
+#include "dune-raw-data/Overlays/FelixFormat.hh"
+#include "dune-raw-data/Overlays/FelixFragment.hh"
+
+namespace dune {
+
+// Maps a capture file of back-to-back FELIX frames into memory and hands out
+// FelixFragment overlays on the mapping, so frames are never copied. A large
+// capture can be walked as a sequence of fragment-sized views with
+// fragment(i, frames_per_fragment). Views must not outlive the map.
+class FelixFileMap {
+ public:
+  // populate pre-faults the whole file (MAP_POPULATE) so that the first pass
+  // over it does not stall on page faults; sequential tells the kernel to
+  // read ahead aggressively.
+  explicit FelixFileMap(const std::string& fileName,
+                        const bool populate = false,
+                        const bool sequential = true) {
+    const int fd = open(fileName.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw cet::exception("FelixFileMap")
+          << "Cannot open " << fileName << ": " << strerror(errno);
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      const int err = errno;
+      close(fd);
+      throw cet::exception("FelixFileMap")
+          << "Cannot stat " << fileName << ": " << strerror(err);
+    }
+    size_ = st.st_size;
+    if (size_ > 0) {
+      int flags = MAP_PRIVATE;
+#ifdef MAP_POPULATE
+      if (populate) flags |= MAP_POPULATE;
+#else
+      (void)populate;
+#endif
+      void* p = mmap(nullptr, size_, PROT_READ, flags, fd, 0);
+      if (p == MAP_FAILED) {
+        const int err = errno;
+        close(fd);
+        throw cet::exception("FelixFileMap")
+            << "Cannot map " << fileName << ": " << strerror(err);
+      }
+      data_ = static_cast<const uint8_t*>(p);
+      if (sequential) {
+        madvise(const_cast<uint8_t*>(data_), size_, MADV_SEQUENTIAL);
+      }
+    }
+    // The mapping stays valid after the descriptor is closed.
+    close(fd);
+  }
+
+  ~FelixFileMap() {
+    if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+  }
+
+  FelixFileMap(const FelixFileMap&) = delete;
+  FelixFileMap& operator=(const FelixFileMap&) = delete;
+
+  const uint8_t* data() const { return data_; }
+  size_t size() const { return size_; }
+  // Number of whole frames in the file.
+  size_t num_frames() const { return size_ / sizeof(FelixFrame); }
+
+  // Number of views of frames_per_fragment frames; the last one may be
+  // shorter.
+  size_t num_fragments(const size_t frames_per_fragment) const {
+    return (num_frames() + frames_per_fragment - 1) / frames_per_fragment;
+  }
+  // View of the i-th group of frames_per_fragment frames.
+  FelixFragment fragment(const size_t i,
+                         const size_t frames_per_fragment) const {
+    const size_t first = i * frames_per_fragment;
+    const size_t n = std::min(frames_per_fragment, num_frames() - first);
+    return FelixFragment(data_ + first * sizeof(FelixFrame),
+                         n * sizeof(FelixFrame));
+  }
+  // View of all frames in the file.
+  FelixFragment fragment() const {
+    return FelixFragment(data_, num_frames() * sizeof(FelixFrame));
+  }
+
+  // Asks the kernel to read the given frames ahead, e.g. the next fragment
+  // while the current one is processed.
+  void prefetch(const size_t first_frame, const size_t num_frames) const {
+    const size_t page = sysconf(_SC_PAGESIZE);
+    const size_t begin = first_frame * sizeof(FelixFrame) / page * page;
+    const size_t end =
+        std::min(size_, (first_frame + num_frames) * sizeof(FelixFrame));
+    if (begin < end) {
+      madvise(const_cast<uint8_t*>(data_) + begin, end - begin,
+              MADV_WILLNEED);
+    }
+  }
+
+ private:
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+};
+
+}  // namespace dune
+
+#endif /* artdaq_dune_Overlays_FelixFile_hh */
@@ -4,10 +4,19 @@
 #ifndef artdaq_dune_Overlays_FelixFormat_hh
 #define artdaq_dune_Overlays_FelixFormat_hh
 
+#include <algorithm>
 #include <bitset>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
 #include <vector>
 
+#include "cetlib/exception.h"
+
+#if defined(__AVX2__) || defined(__SSSE3__) || defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
 namespace dune {
 
 typedef uint32_t word_t;
@@ -261,6 +270,43 @@ struct ColdataBlock {
   }
 };
 
+//======================
+// Channel offset table
+//======================
+// Byte offset within a frame of the four bytes that hold a channel
+// (0-255). Within a COLDATA segment, ADC a owns bytes a, a+2, a+4 and
+// a+6, a+8, a+10, each triplet holding two little-endian 12-bit values, so
+// a channel always lies within bytes offset..offset+3: an even channel in
+// byte 0 and the low nibble of byte 2, an odd channel in the high nibble of
+// byte 0 and byte 2.
+constexpr size_t felix_channel_offset(const unsigned ch) {
+  return sizeof(WIBHeader) + (ch / 64) * sizeof(ColdataBlock) +
+         sizeof(ColdataHeader) +
+         (((ch % 64) / 16) * 2 + (ch % 8) / 4) * sizeof(ColdataSegment) +
+         (ch % 64) / 8 % 2 + (ch % 4 / 2) * 6 + (ch % 2) * 2;
+}
+
+// Extracts a channel from the 32-bit little-endian word at its offset.
+constexpr uint16_t felix_channel_from_word(const uint32_t w, const bool odd) {
+  return odd ? ((w >> 4) & 0xf) | ((w >> 12) & 0xff0)
+             : (w & 0xff) | ((w >> 8) & 0xf00);
+}
+
+struct FelixChannelTable {
+  uint16_t offset[256];
+};
+
+constexpr FelixChannelTable make_felix_channel_table() {
+  FelixChannelTable table{};
+  for (unsigned ch = 0; ch < 256; ++ch) {
+    table.offset[ch] = felix_channel_offset(ch);
+  }
+  return table;
+}
+
+static constexpr FelixChannelTable felix_channel_table =
+    make_felix_channel_table();
+
 //=============
 // FELIX frame
 //=============
@@ -361,9 +407,31 @@ class FelixFrame {
     return blocks[block_num].channel(adc, ch);
   }
   uint16_t channel(const uint8_t block_num, const uint8_t ch) const {
-    return channel(block_num, ch / 8, ch % 8);
+    return channel(block_num * num_ch_per_block + ch);
+  }
+  // One table lookup, one unaligned load and a bit extraction.
+  uint16_t channel(const uint8_t ch) const {
+    uint32_t w;
+    memcpy(&w, reinterpret_cast<const uint8_t*>(this) +
+                   felix_channel_table.offset[ch],
+           sizeof(w));
+#if defined(__BMI2__)
+    return _pext_u32(w, ch % 2 ? 0x00ff00f0 : 0x000f00ff);
+#else
+    return felix_channel_from_word(w, ch % 2);
+#endif
+  }
+  // Same for a channel known at compile time, with the offset and masks
+  // folded into the code.
+  template <unsigned CH>
+  adc_t channel() const {
+    static_assert(CH < num_ch_per_frame, "FELIX frames hold 256 channels");
+    uint32_t w;
+    memcpy(&w, reinterpret_cast<const uint8_t*>(this) +
+                   felix_channel_offset(CH),
+           sizeof(w));
+    return felix_channel_from_word(w, CH % 2);
   }
-  uint16_t channel(const uint8_t ch) const { return channel(ch / 64, ch % 64); }
   // Channel mutators
   void set_channel(const uint8_t block_num, const uint8_t adc, const uint8_t ch,
                    const uint16_t new_val) {
@@ -376,6 +444,141 @@ class FelixFrame {
     set_channel(ch / 64, ch % 64, new_val);
   }
 
+  // Bulk channel accessor: decodes all 256 ADC values of the frame in a single
+  // pass, so that out[ch] == channel(ch) for every channel.
+  //
+  // Within a COLDATA segment the two ADCs are byte-interleaved: ADC a of the
+  // segment owns bytes a, a+2, a+4 (channels 0 and 1) and a+6, a+8, a+10
+  // (channels 2 and 3), each triplet holding two little-endian 12-bit values.
+  // Two consecutive segments therefore contain all eight channels of two ADCs.
+  void unpack_all(adc_t out[num_ch_per_frame]) const {
+#if defined(__AVX2__)
+    // One 128-bit lane per segment pair, two pairs per instruction. The last
+    // 16-byte load of a block reads at most up to the CRC word, so it never
+    // leaves the frame.
+    const __m256i shuf = _mm256_setr_epi8(
+        0, 2, 2, 4, 6, 8, 8, 10, 1, 3, 3, 5, 7, 9, 9, 11,
+        0, 2, 2, 4, 6, 8, 8, 10, 1, 3, 3, 5, 7, 9, 9, 11);
+    const __m256i even_mask = _mm256_set1_epi32(0x00000fff);
+    const __m256i odd_mask = _mm256_set1_epi32(0xffff0000);
+    for (unsigned b = 0; b < 4; ++b) {
+      const uint8_t* seg = reinterpret_cast<const uint8_t*>(blocks[b].segments);
+      adc_t* dst = out + b * num_ch_per_block;
+      for (unsigned half = 0; half < 2; ++half, seg += 48, dst += 32) {
+        const __m256i a = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(seg))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(seg + 24)), 1);
+        const __m256i c = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(seg + 12))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(seg + 36)), 1);
+        const __m256i xa = _mm256_shuffle_epi8(a, shuf);
+        const __m256i xc = _mm256_shuffle_epi8(c, shuf);
+        __m256i ev = _mm256_unpacklo_epi64(xa, xc);
+        __m256i od = _mm256_unpackhi_epi64(xa, xc);
+        ev = _mm256_or_si256(_mm256_and_si256(ev, even_mask),
+                             _mm256_and_si256(_mm256_srli_epi16(ev, 4), odd_mask));
+        od = _mm256_or_si256(_mm256_and_si256(od, even_mask),
+                             _mm256_and_si256(_mm256_srli_epi16(od, 4), odd_mask));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst),
+                            _mm256_permute2x128_si256(ev, od, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 16),
+                            _mm256_permute2x128_si256(ev, od, 0x31));
+      }
+    }
+#elif defined(__SSSE3__)
+    const __m128i shuf =
+        _mm_setr_epi8(0, 2, 2, 4, 6, 8, 8, 10, 1, 3, 3, 5, 7, 9, 9, 11);
+    const __m128i even_mask = _mm_set1_epi32(0x00000fff);
+    const __m128i odd_mask = _mm_set1_epi32(0xffff0000);
+    for (unsigned b = 0; b < 4; ++b) {
+      const uint8_t* seg = reinterpret_cast<const uint8_t*>(blocks[b].segments);
+      adc_t* dst = out + b * num_ch_per_block;
+      for (unsigned pair = 0; pair < 4; ++pair, seg += 24, dst += 16) {
+        const __m128i xa = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(seg)), shuf);
+        const __m128i xc = _mm_shuffle_epi8(
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(seg + 12)), shuf);
+        __m128i ev = _mm_unpacklo_epi64(xa, xc);
+        __m128i od = _mm_unpackhi_epi64(xa, xc);
+        ev = _mm_or_si128(_mm_and_si128(ev, even_mask),
+                          _mm_and_si128(_mm_srli_epi16(ev, 4), odd_mask));
+        od = _mm_or_si128(_mm_and_si128(od, even_mask),
+                          _mm_and_si128(_mm_srli_epi16(od, 4), odd_mask));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), ev);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 8), od);
+      }
+    }
+#else
+    for (unsigned b = 0; b < 4; ++b) {
+      const uint8_t* seg = reinterpret_cast<const uint8_t*>(blocks[b].segments);
+      for (unsigned s = 0; s < num_seg_per_block; ++s, seg += 12) {
+        for (unsigned a = 0; a < 2; ++a) {
+          adc_t* dst = out + b * num_ch_per_block + ((s / 2) * 2 + a) * 8 +
+                       (s % 2) * 4;
+          const uint8_t* p = seg + a;
+          dst[0] = p[0] | (p[2] & 0xf) << 8;
+          dst[1] = p[2] >> 4 | p[4] << 4;
+          dst[2] = p[6] | (p[8] & 0xf) << 8;
+          dst[3] = p[8] >> 4 | p[10] << 4;
+        }
+      }
+    }
+#endif
+  }
+
+  // Bulk channel mutator, the inverse of unpack_all: packs all 256 ADC values
+  // so that channel(ch) == in[ch] afterwards. Only the ADC bits of the
+  // COLDATA blocks are written; the headers and the CRC are left untouched.
+  void pack_all(const adc_t in[num_ch_per_frame]) {
+#if defined(__SSSE3__)
+    // Each pair of 12-bit values becomes three bytes in a 32-bit lane; the two
+    // ADCs of a segment pair are then byte-interleaved.
+    const __m128i lo_mask = _mm_set1_epi32(0x00000fff);
+    const __m128i hi_mask = _mm_set1_epi32(0x00fff000);
+    const __m128i shuf =
+        _mm_setr_epi8(0, 1, 2, 3, 4, 5, 8, 9, 10, 11, 12, 13, -1, -1, -1, -1);
+    for (unsigned b = 0; b < 4; ++b) {
+      uint8_t* seg = reinterpret_cast<uint8_t*>(blocks[b].segments);
+      const adc_t* src = in + b * num_ch_per_block;
+      for (unsigned pair = 0; pair < 4; ++pair, seg += 24, src += 16) {
+        __m128i ev = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+        __m128i od = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 8));
+        ev = _mm_or_si128(_mm_and_si128(ev, lo_mask),
+                          _mm_and_si128(_mm_srli_epi32(ev, 4), hi_mask));
+        od = _mm_or_si128(_mm_and_si128(od, lo_mask),
+                          _mm_and_si128(_mm_srli_epi32(od, 4), hi_mask));
+        const __m128i first = _mm_shuffle_epi8(_mm_unpacklo_epi8(ev, od), shuf);
+        const __m128i second = _mm_shuffle_epi8(_mm_unpackhi_epi8(ev, od), shuf);
+        // The first store spills four bytes into the second segment, which
+        // are overwritten next; the second one must stay inside the pair.
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(seg), first);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(seg + 12), second);
+        const uint32_t tail = _mm_cvtsi128_si32(_mm_srli_si128(second, 8));
+        memcpy(seg + 20, &tail, sizeof(tail));
+      }
+    }
+#else
+    for (unsigned b = 0; b < 4; ++b) {
+      uint8_t* seg = reinterpret_cast<uint8_t*>(blocks[b].segments);
+      for (unsigned s = 0; s < num_seg_per_block; ++s, seg += 12) {
+        for (unsigned a = 0; a < 2; ++a) {
+          const adc_t* src = in + b * num_ch_per_block +
+                             ((s / 2) * 2 + a) * 8 + (s % 2) * 4;
+          uint8_t* p = seg + a;
+          p[0] = src[0];
+          p[2] = (src[0] >> 8 & 0xf) | (src[1] & 0xf) << 4;
+          p[4] = src[1] >> 4;
+          p[6] = src[2];
+          p[8] = (src[2] >> 8 & 0xf) | (src[3] & 0xf) << 4;
+          p[10] = src[3] >> 4;
+        }
+      }
+    }
+#endif
+  }
+
   // CRC32 accessor
   uint32_t CRC32() const { return CRC32_1; }
   // CRC32 mutator
@@ -393,103 +596,426 @@ class FelixFrame {
   }
 };
 
+//=======================
+// Compact header columns
+//=======================
+// The WIB and COLDATA headers of a reordered fragment stored field group by
+// field group rather than frame by frame. Every column holds one 64-bit
+// value per frame, coded either as runs of arithmetic progressions or
+// verbatim, whichever is smaller. Fields that are constant over a link,
+// counters and timestamps thus take a single run, plus one or two runs per
+// glitch; only the COLDATA checksums, which depend on the ADC data, are
+// usually kept verbatim. Headers are expanded on demand by looking up their
+// columns, so any frame can be read without decoding the others.
+//
+// Columns: WIB words 0 and 1, WIB words 2 and 3 as one 64-bit value
+// (timestamp and counter), the four words of each COLDATA header without
+// their checksum bytes, and the two checksums of each block (a | b << 16).
+//
+// Section layout:
+//   word_t column_offset[num_columns] | padding to 8 | columns
+// Column layout (8-byte aligned):
+//   word_t kind | word_t count | count Runs (runs) or count values of
+//   4 (raw32) or 8 (raw64) bytes
+class FelixHeaderColumns {
+ public:
+  enum Kind : word_t { runs = 0, raw32 = 1, raw64 = 2 };
+
+  // Frames [first_frame, next run's first_frame) have the values
+  // value + (frame - first_frame) * stride, modulo 2^64.
+  struct Run {
+    uint64_t first_frame;
+    uint64_t value;
+    uint64_t stride;
+  };
+
+  static constexpr unsigned num_blocks = 4;
+  static constexpr unsigned num_columns = 3 + 5 * num_blocks;
+
+  explicit FelixHeaderColumns(const uint8_t* section) : section_(section) {}
+
+  // Column values of the headers of one frame.
+  static void split(const WIBHeader& wib, const ColdataHeader* blocks,
+                    uint64_t* values) {
+    word_t w[4];
+    memcpy(w, &wib, sizeof(w));
+    values[0] = w[0];
+    values[1] = w[1];
+    values[2] = w[2] | uint64_t(w[3]) << 32;
+    for (unsigned b = 0; b < num_blocks; ++b) {
+      memcpy(w, blocks + b, sizeof(w));
+      uint64_t* v = values + 3 + 4 * b;
+      v[0] = w[0] & 0x0000ffff;
+      v[1] = w[1] & 0xffff0000;
+      v[2] = w[2];
+      v[3] = w[3];
+      values[3 + 4 * num_blocks + b] =
+          blocks[b].checksum_a() | word_t(blocks[b].checksum_b()) << 16;
+    }
+  }
+
+  // Encodes the columns of num_frames frames; values[c*num_frames + i] is
+  // the value of column c for frame i.
+  static std::vector<uint8_t> encode(const uint64_t* values,
+                                     const size_t num_frames) {
+    std::vector<uint8_t> out(
+        (num_columns * sizeof(word_t) + 7) / 8 * 8, 0);
+    for (unsigned c = 0; c < num_columns; ++c) {
+      const word_t offset = out.size();
+      memcpy(out.data() + c * sizeof(word_t), &offset, sizeof(offset));
+      encode_column_(values + c * num_frames, num_frames, out);
+    }
+    return out;
+  }
+
+  uint64_t value(const unsigned column, const size_t frame) const {
+    word_t offset, kind, count;
+    memcpy(&offset, section_ + column * sizeof(word_t), sizeof(offset));
+    const uint8_t* col = section_ + offset;
+    memcpy(&kind, col, sizeof(kind));
+    memcpy(&count, col + sizeof(word_t), sizeof(count));
+    const uint8_t* data = col + 2 * sizeof(word_t);
+    if (kind == raw32) {
+      word_t v;
+      memcpy(&v, data + frame * sizeof(v), sizeof(v));
+      return v;
+    }
+    if (kind == raw64) {
+      uint64_t v;
+      memcpy(&v, data + frame * sizeof(v), sizeof(v));
+      return v;
+    }
+    const Run* begin = reinterpret_cast<const Run*>(data);
+    const Run* run =
+        std::upper_bound(begin, begin + count, frame,
+                         [](const uint64_t f, const Run& r) {
+                           return f < r.first_frame;
+                         }) - 1;
+    return run->value + (frame - run->first_frame) * run->stride;
+  }
+
+  WIBHeader wib_header(const size_t frame) const {
+    const uint64_t time = value(2, frame);
+    const word_t w[4] = {word_t(value(0, frame)), word_t(value(1, frame)),
+                         word_t(time), word_t(time >> 32)};
+    WIBHeader wib;
+    memcpy(&wib, w, sizeof(wib));
+    return wib;
+  }
+
+  ColdataHeader coldata_header(const size_t frame,
+                               const unsigned block) const {
+    const unsigned c = 3 + 4 * block;
+    const word_t sums = value(3 + 4 * num_blocks + block, frame);
+    const word_t w[4] = {
+        word_t(value(c, frame)) | (sums & 0xff) << 16 | (sums >> 16 & 0xff)
+                                                            << 24,
+        word_t(value(c + 1, frame)) | (sums >> 8 & 0xff) | (sums >> 24) << 8,
+        word_t(value(c + 2, frame)), word_t(value(c + 3, frame))};
+    ColdataHeader head;
+    memcpy(&head, w, sizeof(head));
+    return head;
+  }
+
+ private:
+  static void encode_column_(const uint64_t* v, const size_t n,
+                             std::vector<uint8_t>& out) {
+    std::vector<Run> r;
+    bool fits32 = true;
+    for (size_t i = 0; i < n;) {
+      Run run = {i, v[i], 0};
+      // A value that does not start a progression is a run of its own.
+      if (i + 1 < n &&
+          (i + 2 >= n || v[i + 2] - v[i + 1] == v[i + 1] - v[i])) {
+        run.stride = v[i + 1] - v[i];
+      }
+      size_t j = i + 1;
+      while (j < n && v[j] == run.value + (j - i) * run.stride) ++j;
+      for (size_t k = i; k < j; ++k) fits32 &= v[k] >> 32 == 0;
+      r.push_back(run);
+      i = j;
+    }
+
+    const size_t raw_bytes = n * (fits32 ? sizeof(word_t) : sizeof(uint64_t));
+    const word_t kind =
+        r.size() * sizeof(Run) <= raw_bytes ? runs : fits32 ? raw32 : raw64;
+    const word_t count = kind == runs ? r.size() : n;
+    const size_t start = out.size();
+    out.resize(start + 2 * sizeof(word_t));
+    memcpy(out.data() + start, &kind, sizeof(kind));
+    memcpy(out.data() + start + sizeof(word_t), &count, sizeof(count));
+    if (kind == runs) {
+      const uint8_t* p = reinterpret_cast<const uint8_t*>(r.data());
+      out.insert(out.end(), p, p + r.size() * sizeof(Run));
+    } else if (kind == raw64) {
+      const uint8_t* p = reinterpret_cast<const uint8_t*>(v);
+      out.insert(out.end(), p, p + n * sizeof(uint64_t));
+    } else {
+      for (size_t i = 0; i < n; ++i) {
+        const word_t w = v[i];
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&w);
+        out.insert(out.end(), p, p + sizeof(w));
+      }
+    }
+    out.resize((out.size() + 7) / 8 * 8, 0);
+  }
+
+  const uint8_t* section_;
+};
+
 //========================
 // Reordered FELIX frames
 //========================
+// Overlay for a reordered fragment. The fragment starts with a small layout
+// header that records the number of frames and the byte offset of each
+// section, so fragments of any length can be reordered:
+//
+//   Header | WIB headers | CRC32s | COLDATA headers | ADCs (channel-major)
+//
+// With raw ADC encoding, channel ch of frame i lives at
+// ADCs[ch*adc_row_stride + i]. Other encodings store the ADC section in a
+// compressed form (see FelixCompress.hh) and are decoded by the overlay.
+// With compact headers, the WIB and COLDATA headers share one section of
+// FelixHeaderColumns in front of the CRC32s:
+//
+//   Header | header columns | CRC32s | ADCs
 class ReorderedFelixFrames {
- private:
-  WIBHeader head[10000];
-  word_t CRC32_[10000];
-  ColdataHeader blockhead[10000*4];
-  adc_t ADCs[10000*256];
-
  public:
+  // Version 2 added adc_encoding. Version 3 added header_encoding, the
+  // adc_packed12 and adc_block_for encodings and rows padded to 32 values.
+  // Version 2 fragments have the same header and can still be read.
+  static constexpr word_t format_version = 3;
+  static constexpr word_t min_format_version = 2;
+
+  // Encodings of the ADC section.
+  enum AdcEncoding : word_t {
+    adc_raw16 = 0,          // uint16_t per value, channel-major rows
+    adc_delta_huffman = 1,  // per-channel deltas, Huffman coded
+    adc_packed12 = 2,       // 12 bits per value, channel-major rows
+    adc_block_for = 3,      // tick blocks, frame of reference + exceptions
+  };
+
+  // Encodings of the WIB and COLDATA header sections.
+  enum HeaderEncoding : word_t {
+    headers_raw = 0,      // one WIBHeader and four ColdataHeaders per frame
+    headers_compact = 1,  // FelixHeaderColumns
+  };
+
+  struct Header {
+    word_t version;
+    word_t num_frames;
+    word_t adc_row_stride;
+    word_t adc_encoding;
+    word_t wib_headers_offset;
+    word_t crc32_offset;
+    word_t coldata_headers_offset;
+    word_t adc_offset;
+    word_t adc_bytes;
+    word_t header_encoding;
+    word_t reserved[2];
+  };
+
   static constexpr unsigned frame_size = sizeof(WIBHeader)+sizeof(word_t)+4*sizeof(ColdataHeader)+256*sizeof(adc_t);
 
-  // ReorderedFelixFrames(const artdaq::Fragment fragment)
-  //     : head(fragment.dataSizeBytes() / frame_size),
-  //       blockhead(fragment.dataSizeBytes() / frame_size * 4),
-  //       CRC32_(fragment.dataSizeBytes() / frame_size),
-  //       ADCs(fragment.dataSizeBytes() / frame_size * 256) {}
+  // Bytes per channel row of adc_packed12 data with the given row stride.
+  // Two values share three bytes: v0 | v1 << 12, little-endian.
+  static size_t packed_row_bytes(const size_t adc_row_stride) {
+    return adc_row_stride / 2 * 3;
+  }
+
+  // Layout of a reordered fragment holding num_frames frames, with the ADC
+  // section in one of the fixed-size encodings (adc_raw16 or adc_packed12).
+  static Header layout(const size_t num_frames,
+                       const AdcEncoding encoding = adc_raw16) {
+    Header h;
+    h.version = format_version;
+    h.num_frames = num_frames;
+    // Rows are padded to whole cache lines so that they can be streamed out.
+    h.adc_row_stride = (num_frames + 31) / 32 * 32;
+    h.adc_encoding = encoding;
+    h.wib_headers_offset = sizeof(Header);
+    h.crc32_offset = h.wib_headers_offset + num_frames * sizeof(WIBHeader);
+    h.coldata_headers_offset = h.crc32_offset + num_frames * sizeof(word_t);
+    h.adc_offset =
+        (h.coldata_headers_offset + num_frames * 4 * sizeof(ColdataHeader) +
+         63) / 64 * 64;
+    h.adc_bytes = encoding == adc_packed12
+                      ? 256 * packed_row_bytes(h.adc_row_stride)
+                      : h.adc_row_stride * 256 * sizeof(adc_t);
+    h.header_encoding = headers_raw;
+    h.reserved[0] = h.reserved[1] = 0;
+    return h;
+  }
+  // Total size in bytes of a fragment with the given layout.
+  static size_t size_bytes(const Header& h) { return h.adc_offset + h.adc_bytes; }
+
+  const Header& header() const { return header_; }
+
+  // Throws unless this reader understands the fragment: a version from
+  // min_format_version to format_version and known encodings.
+  void validate() const {
+    if (header_.version < min_format_version ||
+        header_.version > format_version) {
+      throw cet::exception("ReorderedFelixFrames")
+          << "Unsupported format version " << header_.version
+          << ", expected " << word_t(min_format_version) << " to "
+          << word_t(format_version) << ".";
+    }
+    if (header_.adc_encoding > adc_block_for) {
+      throw cet::exception("ReorderedFelixFrames")
+          << "Unknown ADC encoding " << header_.adc_encoding << ".";
+    }
+    if (header_.header_encoding > headers_compact) {
+      throw cet::exception("ReorderedFelixFrames")
+          << "Unknown header encoding " << header_.header_encoding << ".";
+    }
+  }
+
+ private:
+  Header header_;
+
+  uint8_t const* bytes_() const { return reinterpret_cast<uint8_t const*>(this); }
+  uint8_t* bytes_() { return reinterpret_cast<uint8_t*>(this); }
+  WIBHeader const* head_(const size_t frame_ID) const {
+    return reinterpret_cast<WIBHeader const*>(bytes_() + header_.wib_headers_offset) + frame_ID;
+  }
+  // The writable headers are only used by the header mutators, which cannot
+  // update compact header columns in place.
+  WIBHeader* head_(const size_t frame_ID) {
+    require_raw_headers_();
+    return reinterpret_cast<WIBHeader*>(bytes_() + header_.wib_headers_offset) + frame_ID;
+  }
+  ColdataHeader const* blockhead_(const size_t frame_ID, const uint8_t block_num) const {
+    return reinterpret_cast<ColdataHeader const*>(bytes_() + header_.coldata_headers_offset) + frame_ID*4 + block_num;
+  }
+  ColdataHeader* blockhead_(const size_t frame_ID, const uint8_t block_num) {
+    require_raw_headers_();
+    return reinterpret_cast<ColdataHeader*>(bytes_() + header_.coldata_headers_offset) + frame_ID*4 + block_num;
+  }
+  word_t const* CRC32_() const {
+    return reinterpret_cast<word_t const*>(bytes_() + header_.crc32_offset);
+  }
+  word_t* CRC32_() { return reinterpret_cast<word_t*>(bytes_() + header_.crc32_offset); }
+  adc_t const* ADCs_() const {
+    return reinterpret_cast<adc_t const*>(bytes_() + header_.adc_offset);
+  }
+  adc_t* ADCs_() { return reinterpret_cast<adc_t*>(bytes_() + header_.adc_offset); }
+  // Throws unless the ADC section has the encoding an accessor reads.
+  void require_adc_encoding_(const AdcEncoding encoding,
+                             const char* what) const {
+    if (header_.adc_encoding != encoding) {
+      throw cet::exception("ReorderedFelixFrames")
+          << what << " needs ADC encoding " << encoding
+          << ", the fragment has " << header_.adc_encoding << ".";
+    }
+  }
+  void require_raw_headers_() const {
+    if (header_.header_encoding != headers_raw) {
+      throw cet::exception("ReorderedFelixFrames")
+          << "Header mutators need raw headers, the fragment has header "
+          << "encoding " << header_.header_encoding << ".";
+    }
+  }
+
+ public:
+  // Headers of a frame, expanded from the header columns if they are
+  // compact. The header mutators below only apply to raw headers and throw
+  // cet::exception for compact ones.
+  WIBHeader wib_header(const size_t frame_ID) const {
+    if (header_.header_encoding == headers_compact) {
+      return FelixHeaderColumns(bytes_() + header_.wib_headers_offset)
+          .wib_header(frame_ID);
+    }
+    return *head_(frame_ID);
+  }
+  ColdataHeader coldata_header(const size_t frame_ID,
+                               const uint8_t block_num) const {
+    if (header_.header_encoding == headers_compact) {
+      return FelixHeaderColumns(bytes_() + header_.coldata_headers_offset)
+          .coldata_header(frame_ID, block_num);
+    }
+    return *blockhead_(frame_ID, block_num);
+  }
 
   // WIB header accessors
-  uint8_t sof(const size_t frame_ID = 0) const { return head[frame_ID].sof; }
-  uint8_t version(const size_t frame_ID = 0) const { return head[frame_ID].version; }
-  uint8_t fiber_no(const size_t frame_ID = 0) const { return head[frame_ID].fiber_no; }
-  uint8_t crate_no(const size_t frame_ID = 0) const { return head[frame_ID].crate_no; }
-  uint8_t slot_no(const size_t frame_ID = 0) const { return head[frame_ID].slot_no; }
-  uint8_t mm(const size_t frame_ID = 0) const { return head[frame_ID].mm; }
-  uint8_t oos(const size_t frame_ID = 0) const { return head[frame_ID].oos; }
-  uint16_t wib_errors(const size_t frame_ID = 0) const { return head[frame_ID].wib_errors; }
-  uint64_t timestamp(const size_t frame_ID = 0) const { return head[frame_ID].timestamp(); }
-  uint16_t wib_counter(const size_t frame_ID = 0) const { return head[frame_ID].wib_counter(); }
-  uint8_t z(const size_t frame_ID = 0) const { return head[frame_ID].z; }
+  uint8_t sof(const size_t frame_ID = 0) const { return wib_header(frame_ID).sof; }
+  uint8_t version(const size_t frame_ID = 0) const { return wib_header(frame_ID).version; }
+  uint8_t fiber_no(const size_t frame_ID = 0) const { return wib_header(frame_ID).fiber_no; }
+  uint8_t crate_no(const size_t frame_ID = 0) const { return wib_header(frame_ID).crate_no; }
+  uint8_t slot_no(const size_t frame_ID = 0) const { return wib_header(frame_ID).slot_no; }
+  uint8_t mm(const size_t frame_ID = 0) const { return wib_header(frame_ID).mm; }
+  uint8_t oos(const size_t frame_ID = 0) const { return wib_header(frame_ID).oos; }
+  uint16_t wib_errors(const size_t frame_ID = 0) const { return wib_header(frame_ID).wib_errors; }
+  uint64_t timestamp(const size_t frame_ID = 0) const { return wib_header(frame_ID).timestamp(); }
+  uint16_t wib_counter(const size_t frame_ID = 0) const { return wib_header(frame_ID).wib_counter(); }
+  uint8_t z(const size_t frame_ID = 0) const { return wib_header(frame_ID).z; }
   // WIB header mutators
-  void set_sof(const size_t frame_ID, const uint8_t new_sof) { head[frame_ID].sof = new_sof; }
-  void set_version(const size_t frame_ID, const uint8_t new_version) { head[frame_ID].version = new_version; }
-  void set_fiber_no(const size_t frame_ID, const uint8_t new_fiber_no) { head[frame_ID].fiber_no = new_fiber_no; }
-  void set_crate_no(const size_t frame_ID, const uint8_t new_crate_no) { head[frame_ID].crate_no = new_crate_no; }
-  void set_slot_no(const size_t frame_ID, const uint8_t new_slot_no) { head[frame_ID].slot_no = new_slot_no; }
-  void set_mm(const size_t frame_ID, const uint8_t new_mm) { head[frame_ID].mm = new_mm; }
-  void set_oos(const size_t frame_ID, const uint8_t new_oos) { head[frame_ID].oos = new_oos; }
+  void set_sof(const size_t frame_ID, const uint8_t new_sof) { head_(frame_ID)->sof = new_sof; }
+  void set_version(const size_t frame_ID, const uint8_t new_version) { head_(frame_ID)->version = new_version; }
+  void set_fiber_no(const size_t frame_ID, const uint8_t new_fiber_no) { head_(frame_ID)->fiber_no = new_fiber_no; }
+  void set_crate_no(const size_t frame_ID, const uint8_t new_crate_no) { head_(frame_ID)->crate_no = new_crate_no; }
+  void set_slot_no(const size_t frame_ID, const uint8_t new_slot_no) { head_(frame_ID)->slot_no = new_slot_no; }
+  void set_mm(const size_t frame_ID, const uint8_t new_mm) { head_(frame_ID)->mm = new_mm; }
+  void set_oos(const size_t frame_ID, const uint8_t new_oos) { head_(frame_ID)->oos = new_oos; }
   void set_wib_errors(const size_t frame_ID, const uint16_t new_wib_errors) {
-    head[frame_ID].wib_errors = new_wib_errors;
+    head_(frame_ID)->wib_errors = new_wib_errors;
   }
-  void set_timestamp(const size_t frame_ID, uint64_t new_timestamp) { head[frame_ID].set_timestamp(new_timestamp); }
+  void set_timestamp(const size_t frame_ID, uint64_t new_timestamp) { head_(frame_ID)->set_timestamp(new_timestamp); }
   void set_wib_counter(const size_t frame_ID, uint16_t new_wib_counter) {
-    head[frame_ID].wib_counter_1 = new_wib_counter;
+    head_(frame_ID)->wib_counter_1 = new_wib_counter;
   }
-  void set_z(const size_t frame_ID, uint8_t new_z) { head[frame_ID].z = new_z; }
+  void set_z(const size_t frame_ID, uint8_t new_z) { head_(frame_ID)->z = new_z; }
 
   // COLDATA header accessors
   uint8_t s1_error(const size_t frame_ID, const uint8_t block_num) const {
-    return blockhead[frame_ID+block_num].s1_error;
+    return coldata_header(frame_ID, block_num).s1_error;
   }
   uint8_t s2_error(const size_t frame_ID, const uint8_t block_num) const {
-    return blockhead[frame_ID+block_num].s2_error;
+    return coldata_header(frame_ID, block_num).s2_error;
   }
   uint16_t checksum_a(const size_t frame_ID, const uint8_t block_num) const {
-    return blockhead[frame_ID+block_num].checksum_a();
+    return coldata_header(frame_ID, block_num).checksum_a();
   }
   uint16_t checksum_b(const size_t frame_ID, const uint8_t block_num) const {
-    return blockhead[frame_ID+block_num].checksum_b();
+    return coldata_header(frame_ID, block_num).checksum_b();
   }
   uint16_t coldata_convert_count(const size_t frame_ID, const uint8_t block_num) const {
-    return blockhead[frame_ID+block_num].coldata_convert_count;
+    return coldata_header(frame_ID, block_num).coldata_convert_count;
   }
   uint16_t error_register(const size_t frame_ID, const uint8_t block_num) const {
-    return blockhead[frame_ID+block_num].error_register;
+    return coldata_header(frame_ID, block_num).error_register;
   }
-  uint8_t hdr(const size_t frame_ID, const uint8_t block_num, const uint8_t i) const { return blockhead[frame_ID+block_num].hdr(i); }
+  uint8_t hdr(const size_t frame_ID, const uint8_t block_num, const uint8_t i) const { return coldata_header(frame_ID, block_num).hdr(i); }
   // COLDATA header mutators
   void set_s1_error(const size_t frame_ID, const uint8_t block_num, const uint8_t new_s1_error) {
-    blockhead[frame_ID+block_num].s1_error = new_s1_error;
+    blockhead_(frame_ID, block_num)->s1_error = new_s1_error;
   }
   void set_s2_error(const size_t frame_ID, const uint8_t block_num, const uint8_t new_s2_error) {
-    blockhead[frame_ID+block_num].s2_error = new_s2_error;
+    blockhead_(frame_ID, block_num)->s2_error = new_s2_error;
   }
   void set_checksum_a(const size_t frame_ID, const uint8_t block_num, const uint16_t new_checksum_a) {
-    blockhead[frame_ID+block_num].set_checksum_a(new_checksum_a);
+    blockhead_(frame_ID, block_num)->set_checksum_a(new_checksum_a);
   }
   void set_checksum_b(const size_t frame_ID, const uint8_t block_num, const uint16_t new_checksum_b) {
-    blockhead[frame_ID+block_num].set_checksum_b(new_checksum_b);
+    blockhead_(frame_ID, block_num)->set_checksum_b(new_checksum_b);
   }
   void set_coldata_convert_count(const size_t frame_ID, const uint8_t block_num,
                                  const uint16_t new_coldata_convert_count) {
-    blockhead[frame_ID+block_num].coldata_convert_count = new_coldata_convert_count;
+    blockhead_(frame_ID, block_num)->coldata_convert_count = new_coldata_convert_count;
   }
   void set_error_register(const size_t frame_ID, const uint8_t block_num, const uint16_t new_error_register) {
-    blockhead[frame_ID+block_num].error_register = new_error_register;
+    blockhead_(frame_ID, block_num)->error_register = new_error_register;
   }
   void set_hdr(const size_t frame_ID, const uint8_t block_num, const uint8_t i, const uint8_t new_hdr) {
-    blockhead[frame_ID*4+block_num].set_hdr(i, new_hdr);
+    blockhead_(frame_ID, block_num)->set_hdr(i, new_hdr);
   }
 
-  size_t total_frames() const { return 10000/* ADCs.size()/256 */; }
+  size_t total_frames() const { return header_.num_frames; }
 
-  // Channel accessors
+  // Channel accessors, for adc_raw16 data only.
   uint16_t channel(const size_t frame_ID, const uint8_t block_num, const uint8_t adc, const uint8_t ch) const {
-    return ADCs[(block_num*64 + adc*8 + ch)*total_frames() + frame_ID];
+    require_adc_encoding_(adc_raw16, "channel()");
+    return ADCs_()[(block_num*64 + adc*8 + ch)*header_.adc_row_stride + frame_ID];
   }
   uint16_t channel(const size_t frame_ID, const uint8_t block_num, const uint8_t ch) const {
     return channel(frame_ID, block_num, ch / 8, ch % 8);
@@ -498,7 +1024,8 @@ class ReorderedFelixFrames {
   // Channel mutators
   void set_channel(const size_t frame_ID, const uint8_t block_num, const uint8_t adc, const uint8_t ch,
                    const uint16_t new_val) {
-    ADCs[(block_num * 64 + adc * 8 + ch) * total_frames() + frame_ID] = new_val;
+    require_adc_encoding_(adc_raw16, "set_channel()");
+    ADCs_()[(block_num * 64 + adc * 8 + ch) * header_.adc_row_stride + frame_ID] = new_val;
   }
   void set_channel(const size_t frame_ID, const uint8_t block_num, const uint8_t ch, const uint16_t new_val) {
     set_channel(frame_ID, block_num, ch / 8, ch % 8, new_val);
@@ -507,24 +1034,45 @@ class ReorderedFelixFrames {
     set_channel(frame_ID, ch / 64, ch % 64, new_val);
   }
 
-  // Waveform accessor
-  // adc_v waveform(const uint8_t ch) {
-  //   return adc_v(ADCs.begin() + ch * total_frames(),
-  //                ADCs.begin() + (ch+1) * total_frames());
-  // }
+  // Pointer to the contiguous row of ADC values of a single channel of
+  // adc_raw16 data.
+  adc_t const* channel_row(const uint8_t ch) const {
+    require_adc_encoding_(adc_raw16, "channel_row()");
+    return ADCs_() + ch * header_.adc_row_stride;
+  }
+  // Pointer to the packed row of a single channel of adc_packed12 data.
+  uint8_t const* packed_row(const uint8_t ch) const {
+    require_adc_encoding_(adc_packed12, "packed_row()");
+    return adc_section() + ch * packed_row_bytes(header_.adc_row_stride);
+  }
+
+  // Start of the ADC section, in whatever encoding the header names.
+  uint8_t const* adc_section() const { return bytes_() + header_.adc_offset; }
+
+  // Waveform accessor, for adc_raw16 data only.
+  adc_v waveform(const uint8_t ch) const {
+    const adc_t* row = channel_row(ch);
+    return adc_v(row, row + total_frames());
+  }
 
   // CRC32 accessor
-  uint32_t CRC32(const size_t frame_ID) const { return CRC32_[frame_ID]; }
+  uint32_t CRC32(const size_t frame_ID) const { return CRC32_()[frame_ID]; }
   // CRC32 mutator
-  void set_CRC32(const size_t frame_ID, const uint32_t new_CRC32) { CRC32_[frame_ID] = new_CRC32; }
+  void set_CRC32(const size_t frame_ID, const uint32_t new_CRC32) { CRC32_()[frame_ID] = new_CRC32; }
 
   // Utility functions
   void print(const size_t frame_ID) const {
     std::cout << "Printing frame " << frame_ID << ":\n";
-    head[frame_ID].print();
+    wib_header(frame_ID).print();
     for (unsigned i = 0; i < 4; ++i) {
-      blockhead[frame_ID*4+i].print();
+      coldata_header(frame_ID, i).print();
 
+      // Encoded ADC sections can only be read through a decoder.
+      if (header_.adc_encoding != adc_raw16) {
+        std::cout << "ADCs not shown, encoding " << header_.adc_encoding
+                  << '\n';
+        continue;
+      }
       std::cout << "\t\t0\t1\t2\t3\t4\t5\t6\t7\n";
       for (int j = 0; j < 8; j++) {
         std::cout << "Stream " << j << ":\t";
@@ -11,13 +11,19 @@
 
 #include "FragmentType.hh"
 #include "artdaq-core/Data/Fragment.hh"
+#include "dune-raw-data/Overlays/FelixCompress.hh"
+#include "dune-raw-data/Overlays/FelixDecode.hh"
 #include "dune-raw-data/Overlays/FelixFormat.hh"
 
+#include <algorithm>
+#include <atomic>
 #include <bitset>
 #include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <map>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -63,20 +69,19 @@ class dune::FelixFragmentBase {
                     Metadata::size_words * sizeof(Metadata::data_t),
                 "FelixFragment::Metadata size changed");
 
-  /* Static file reader for debugging purpose. */
+  /* Static file reader for debugging purpose. The file is read straight into
+   * the new fragment. For large captures, overlay a FelixFileMap instead. */
   static artdaq::FragmentPtr fromFile(const std::string& fileName) {
-    std::ifstream in(fileName, std::ios::binary);
-    std::string contents((std::istreambuf_iterator<char>(in)),
-                         std::istreambuf_iterator<char>());
+    std::ifstream in(fileName, std::ios::binary | std::ios::ate);
+    const size_t size = in ? static_cast<size_t>(in.tellg()) : 0;
+    in.seekg(0);
     Metadata meta;
-    static size_t fragment_ID = 1;
+    static std::atomic<size_t> fragment_ID(1);
     std::unique_ptr<artdaq::Fragment> frag_ptr(artdaq::Fragment::FragmentBytes(
-        contents.size(), 1, fragment_ID, dune::toFragmentType("FELIX"), meta));
-    ++fragment_ID;
+        size, 1, fragment_ID++, dune::toFragmentType("FELIX"), meta));
 
-    frag_ptr->resizeBytes(contents.size());
-    memcpy(frag_ptr->dataBeginBytes(), contents.c_str(), contents.size());
-    in.close();
+    frag_ptr->resizeBytes(size);
+    in.read(reinterpret_cast<char*>(frag_ptr->dataBeginBytes()), size);
     return frag_ptr;
   }
 
@@ -125,8 +130,18 @@ class dune::FelixFragmentBase {
   virtual adc_v get_ADCs_by_channel(const uint8_t block_ID,
                                     const uint8_t channel_ID) const = 0;
   virtual adc_v get_ADCs_by_channel(const uint8_t channel_ID) const = 0;
+  // Function to decode all ADC values of a single channel into out, which
+  // must hold total_frames() values.
+  virtual void decode_channel(const uint8_t channel_ID, adc_t* out) const = 0;
   // Function to return all ADC values for all channels in a map.
   virtual std::map<uint8_t, adc_v> get_all_ADCs() const = 0;
+  // Function to decode all ADC values into a caller-owned channel-major
+  // buffer: dst[ch*stride + frame_ID]. stride must be at least
+  // total_frames() and dst must hold 256*stride values.
+  virtual void decode_all(adc_t* dst, const size_t stride) const = 0;
+  // Function to decode all ADC values into separately placed channel rows:
+  // rows[ch][frame_ID]. Channels whose row is null are skipped.
+  virtual void decode_rows(adc_t* const* rows) const = 0;
 
   // Function to print all timestamps.
   virtual void print_timestamps() const = 0;
@@ -135,11 +150,21 @@ class dune::FelixFragmentBase {
 
   virtual void print_frames() const = 0;
 
-  FelixFragmentBase(const artdaq::Fragment fragment)
+  // Overlays never copy the payload: they refer to the fragment's data, which
+  // must outlive them.
+  FelixFragmentBase(const artdaq::Fragment& fragment)
       : artdaq_Fragment_(fragment.dataBeginBytes()),
         sizeBytes_(fragment.dataSizeBytes()) {}
+  // Overlay on caller-owned memory, e.g. an mmap region or a shared-memory
+  // buffer.
+  FelixFragmentBase(const void* fragmentP, const size_t sizeBytes)
+      : artdaq_Fragment_(fragmentP), sizeBytes_(sizeBytes) {}
   virtual ~FelixFragmentBase() {}
 
+  // Start and size of the payload the overlay refers to.
+  const void* data() const { return artdaq_Fragment_; }
+  size_t size_bytes() const { return sizeBytes_; }
+
   // The number of words in the current event minus the header.
   virtual size_t total_words() const = 0;
   // The number of frames in the current event.
@@ -159,7 +184,7 @@ class dune::FelixFragmentBase {
 //==================================================
 // FELIX fragment for an array of bare FELIX frames
 //==================================================
-class dune::FelixFragmentUnordered : public dune::FelixFragmentBase {
+class dune::FelixFragmentUnordered final : public dune::FelixFragmentBase {
  public:
   /* FELIX-specific metadata from the FelixBoardReader included here for
    * debugging. */
@@ -252,18 +277,42 @@ class dune::FelixFragmentUnordered : public dune::FelixFragmentBase {
   }
   adc_v get_ADCs_by_channel(const uint8_t channel_ID) const {
     adc_v output(total_frames());
+    decode_channel(channel_ID, output.data());
+    return output;
+  }
+  void decode_channel(const uint8_t channel_ID, adc_t* out) const {
     for (size_t i = 0; i < total_frames(); i++) {
-      output[i] = get_ADC(i, channel_ID);
+      out[i] = get_ADC(i, channel_ID);
     }
-    return output;
   }
   // Function to return all ADC values for all channels in a map.
   std::map<uint8_t, adc_v> get_all_ADCs() const {
+    const size_t frames = total_frames();
+    adc_v buffer(frames * FelixFrame::num_ch_per_frame);
+    decode_all(buffer.data(), frames);
     std::map<uint8_t, adc_v> output;
     for (int i = 0; i < 256; i++)
-      output.insert(std::pair<uint8_t, adc_v>(i, get_ADCs_by_channel(i)));
+      output.insert(std::pair<uint8_t, adc_v>(
+          i, adc_v(buffer.begin() + i * frames,
+                   buffer.begin() + (i + 1) * frames)));
     return output;
   }
+  // Decode all frames in one streaming pass using the bulk unpacker, one
+  // pass per run of back-to-back frames if there is a frame table.
+  void decode_all(adc_t* dst, const size_t stride) const {
+    for_each_run_([&](const size_t first, const size_t n) {
+      decode_frames(frame_(first), n, dst + first, stride);
+    });
+  }
+  void decode_rows(adc_t* const* rows) const {
+    for_each_run_([&](const size_t first, const size_t n) {
+      adc_t* shifted[FelixFrame::num_ch_per_frame];
+      for (unsigned ch = 0; ch < FelixFrame::num_ch_per_frame; ++ch) {
+        shifted[ch] = rows[ch] ? rows[ch] + first : nullptr;
+      }
+      decode_frames_to_rows(frame_(first), n, shifted);
+    });
+  }
 
   // Function to print all timestamps.
   void print_timestamps() const {
@@ -284,15 +333,29 @@ class dune::FelixFragmentUnordered : public dune::FelixFragmentBase {
   // The constructor simply sets its const private member "artdaq_Fragment_"
   // to refer to the artdaq::Fragment object
   FelixFragmentUnordered(artdaq::Fragment const& fragment)
-      : FelixFragmentBase(fragment) {
-    std::cout << "Attempting to create a FELIX Fragment.\n";
-  }
+      : FelixFragmentBase(fragment) {}
+  FelixFragmentUnordered(const void* fragmentP, const size_t sizeBytes)
+      : FelixFragmentBase(fragmentP, sizeBytes) {}
+  // Overlay whose frame i starts frame_offsets[i] bytes into the data rather
+  // than at a fixed stride, e.g. from a FelixFrameScanner after corruption.
+  // The offsets must outlive the overlay.
+  FelixFragmentUnordered(const void* fragmentP, const size_t sizeBytes,
+                         const size_t* frame_offsets, const size_t num_frames)
+      : FelixFragmentBase(fragmentP, sizeBytes),
+        offsets_(frame_offsets),
+        num_offsets_(num_frames) {}
 
   // The number of words in the current event minus the header.
   size_t total_words() const { return sizeBytes_ / sizeof(word_t); }
   // The number of frames in the current event.
   size_t total_frames() const {
-    return total_words() / FelixFrame::num_frame_words;
+    return offsets_ ? num_offsets_
+                    : total_words() / FelixFrame::num_frame_words;
+  }
+  // Frame table of the overlay, or nullptr if frames lie back to back.
+  const size_t* frame_offsets() const { return offsets_; }
+  FelixFrame const* frame(const size_t frame_ID) const {
+    return frame_(frame_ID);
   }
   // The number of ADC values describing data beyond the header
   size_t total_adc_values() const {
@@ -302,14 +365,40 @@ class dune::FelixFragmentUnordered : public dune::FelixFragmentBase {
  protected:
   // Allow access to individual frames according to the FelixFrame structure.
   FelixFrame const* frame_(const unsigned& frame_num = 0) const {
+    if (offsets_) {
+      return reinterpret_cast<dune::FelixFrame const*>(
+          static_cast<const uint8_t*>(artdaq_Fragment_) + offsets_[frame_num]);
+    }
     return static_cast<dune::FelixFrame const*>(artdaq_Fragment_) + frame_num;
   }
+
+  // Calls f(first, n) for every run of n back-to-back frames.
+  template <typename F>
+  void for_each_run_(F f) const {
+    const size_t frames = total_frames();
+    if (!offsets_) {
+      if (frames) f(0, frames);
+      return;
+    }
+    for (size_t first = 0; first < frames;) {
+      size_t end = first + 1;
+      while (end < frames &&
+             offsets_[end] == offsets_[end - 1] + sizeof(FelixFrame)) {
+        ++end;
+      }
+      f(first, end - first);
+      first = end;
+    }
+  }
+
+  const size_t* offsets_ = nullptr;
+  size_t num_offsets_ = 0;
 };
 
 //=======================================================
 // FELIX fragment for an array of reordered FELIX frames
 //=======================================================
-class dune::FelixFragmentReordered : public dune::FelixFragmentBase {
+class dune::FelixFragmentReordered final : public dune::FelixFragmentBase {
  public:
   /* FELIX-specific metadata from the FelixBoardReader included here for
    * debugging. */
@@ -317,94 +406,105 @@ class dune::FelixFragmentReordered : public dune::FelixFragmentBase {
 
   /* Frame field and accessors. */
   uint8_t sof(const unsigned& frame_ID = 0) const {
-    return frames_()->sof(frame_ID);
+    return frames_()->sof(first_frame_ + frame_ID);
   }
   uint8_t version(const unsigned& frame_ID = 0) const {
-    return frames_()->version(frame_ID);
+    return frames_()->version(first_frame_ + frame_ID);
   }
   uint8_t fiber_no(const unsigned& frame_ID = 0) const {
-    return frames_()->fiber_no(frame_ID);
+    return frames_()->fiber_no(first_frame_ + frame_ID);
   }
   uint8_t slot_no(const unsigned& frame_ID = 0) const {
-    return frames_()->slot_no(frame_ID);
+    return frames_()->slot_no(first_frame_ + frame_ID);
   }
   uint8_t crate_no(const unsigned& frame_ID = 0) const {
-    return frames_()->crate_no(frame_ID);
+    return frames_()->crate_no(first_frame_ + frame_ID);
   }
   uint8_t mm(const unsigned& frame_ID = 0) const {
-    return frames_()->mm(frame_ID);
+    return frames_()->mm(first_frame_ + frame_ID);
   }
   uint8_t oos(const unsigned& frame_ID = 0) const {
-    return frames_()->oos(frame_ID);
+    return frames_()->oos(first_frame_ + frame_ID);
   }
   uint16_t wib_errors(const unsigned& frame_ID = 0) const {
-    return frames_()->wib_errors(frame_ID);
+    return frames_()->wib_errors(first_frame_ + frame_ID);
   }
   uint64_t timestamp(const unsigned& frame_ID = 0) const {
-    return frames_()->timestamp(frame_ID);
+    return frames_()->timestamp(first_frame_ + frame_ID);
   }
   uint16_t wib_counter(const unsigned& frame_ID = 0) const {
-    return frames_()->wib_counter(frame_ID);
+    return frames_()->wib_counter(first_frame_ + frame_ID);
   }
 
   /* Coldata block accessors. */
   uint8_t s1_error(const unsigned& frame_ID, const uint8_t& block_num) const {
-    return frames_()->s1_error(frame_ID, block_num);
+    return frames_()->s1_error(first_frame_ + frame_ID, block_num);
   }
   uint8_t s2_error(const unsigned& frame_ID, const uint8_t& block_num) const {
-    return frames_()->s2_error(frame_ID, block_num);
+    return frames_()->s2_error(first_frame_ + frame_ID, block_num);
   }
   uint16_t checksum_a(const unsigned& frame_ID,
                       const uint8_t& block_num) const {
-    return frames_()->checksum_a(frame_ID, block_num);
+    return frames_()->checksum_a(first_frame_ + frame_ID, block_num);
   }
   uint16_t checksum_b(const unsigned& frame_ID,
                       const uint8_t& block_num) const {
-    return frames_()->checksum_b(frame_ID, block_num);
+    return frames_()->checksum_b(first_frame_ + frame_ID, block_num);
   }
   uint16_t coldata_convert_count(const unsigned& frame_ID,
                                  const uint8_t& block_num) const {
-    return frames_()->coldata_convert_count(frame_ID, block_num);
+    return frames_()->coldata_convert_count(first_frame_ + frame_ID, block_num);
   }
   uint16_t error_register(const unsigned& frame_ID,
                           const uint8_t& block_num) const {
-    return frames_()->error_register(frame_ID, block_num);
+    return frames_()->error_register(first_frame_ + frame_ID, block_num);
   }
   uint8_t hdr(const unsigned& frame_ID, const uint8_t& block_num,
               const uint8_t& hdr_num) const {
-    return frames_()->hdr(frame_ID, block_num, hdr_num);
+    return frames_()->hdr(first_frame_ + frame_ID, block_num, hdr_num);
   }
 
   /* CRC32 */
   word_t CRC32(const unsigned& frame_ID = 0) const {
-    return frames_()->CRC32(frame_ID);
+    return frames_()->CRC32(first_frame_ + frame_ID);
   }
 
   // Functions to return a certain ADC value.
   adc_t get_ADC(const unsigned& frame_ID, const uint8_t block_ID,
                 const uint8_t channel_ID) const {
-    return frames_()->channel(frame_ID, block_ID, channel_ID);
+    return get_ADC(frame_ID, block_ID * 64 + channel_ID);
   }
   adc_t get_ADC(const unsigned& frame_ID, const uint8_t channel_ID) const {
-    return frames_()->channel(frame_ID, channel_ID);
+    // Packed rows are read in place rather than unpacked as a whole.
+    if (frames_()->header().adc_encoding ==
+        ReorderedFelixFrames::adc_packed12) {
+      return FelixPacked12::value(frames_()->packed_row(channel_ID),
+                                  first_frame_ + frame_ID);
+    }
+    return row_(channel_ID)[frame_ID];
   }
 
   // Function to return all ADC values for a single channel.
   adc_v get_ADCs_by_channel(const uint8_t block_ID,
                             const uint8_t channel_ID) const {
-    adc_v output(total_frames());
-    for (size_t i = 0; i < total_frames(); i++) {
-      output[i] = get_ADC(i, block_ID, channel_ID);
-    }
-    return output;
+    return get_ADCs_by_channel(block_ID * 64 + channel_ID);
   }
   adc_v get_ADCs_by_channel(const uint8_t channel_ID) const {
     adc_v output(total_frames());
-    for (size_t i = 0; i < total_frames(); i++) {
-      output[i] = get_ADC(i, channel_ID);
-    }
+    decode_channel(channel_ID, output.data());
     return output;
   }
+  void decode_channel(const uint8_t channel_ID, adc_t* out) const {
+    // Encoded rows are decoded straight into out, and block coded ones only
+    // over the blocks of the view.
+    if (frames_()->header().adc_encoding != ReorderedFelixFrames::adc_raw16 &&
+        !cached_row_(channel_ID)) {
+      decoder_().decode_range(channel_ID, first_frame_, total_frames(), out);
+      return;
+    }
+    const adc_t* row = row_(channel_ID);
+    std::copy(row, row + total_frames(), out);
+  }
   // Function to return all ADC values for all channels in a map.
   std::map<uint8_t, adc_v> get_all_ADCs() const {
     std::map<uint8_t, adc_v> output;
@@ -412,39 +512,61 @@ class dune::FelixFragmentReordered : public dune::FelixFragmentBase {
       output.insert(std::pair<uint8_t, adc_v>(i, get_ADCs_by_channel(i)));
     return output;
   }
+  // The reordered layout is already channel-major: decode row by row.
+  // Encoded rows go straight into the destination without filling the row
+  // cache.
+  void decode_all(adc_t* dst, const size_t stride) const {
+    for (unsigned ch = 0; ch < FelixFrame::num_ch_per_frame; ++ch) {
+      decode_channel(ch, dst + ch * stride);
+    }
+  }
+  void decode_rows(adc_t* const* rows) const {
+    for (unsigned ch = 0; ch < FelixFrame::num_ch_per_frame; ++ch) {
+      if (rows[ch]) decode_channel(ch, rows[ch]);
+    }
+  }
 
   // Function to print all timestamps.
   void print_timestamps() const {
     for (unsigned int i = 0; i < total_frames(); i++) {
-      std::cout << std::hex << frames_()->timestamp(i) << '\t' << std::dec << i
-                << std::endl;
+      std::cout << std::hex << frames_()->timestamp(first_frame_ + i) << '\t'
+                << std::dec << i << std::endl;
     }
   }
 
-  void print(const unsigned i) const { frames_()->print(i); }
+  void print(const unsigned i) const { frames_()->print(first_frame_ + i); }
 
   void print_frames() const {
     for (unsigned i = 0; i < total_frames(); i++) {
-      frames_()->print(i);
+      frames_()->print(first_frame_ + i);
     }
   }
 
   // The constructor simply sets its const private member "artdaq_Fragment_"
   // to refer to the artdaq::Fragment object
   FelixFragmentReordered(artdaq::Fragment const& fragment)
-      : FelixFragmentBase(fragment) {
-    std::cout << "Attempting to create a FELIX Fragment.\n";
-  }
-  // FelixFragmentReordered(const void* fragmentP, const size_t sizeBytes)
-  //     : artdaq_Fragment_(fragmentP), sizeBytes_(sizeBytes) {
-  //   std::cout << "Attempting to create a FELIX Fragment.\n";
-  // }
+      : FelixFragmentBase(fragment) {}
+  FelixFragmentReordered(const void* fragmentP, const size_t sizeBytes)
+      : FelixFragmentBase(fragmentP, sizeBytes) {}
+  // View of num_frames frames starting at first_frame.
+  FelixFragmentReordered(const void* fragmentP, const size_t sizeBytes,
+                         const size_t first_frame, const size_t num_frames)
+      : FelixFragmentBase(fragmentP, sizeBytes),
+        first_frame_(first_frame),
+        num_frames_(num_frames) {}
 
   // The number of words in the current event minus the header.
   size_t total_words() const { return sizeBytes_ / sizeof(word_t); }
 
   // The number of frames in the current event.
-  size_t total_frames() const { return frames_()->total_frames(); }
+  size_t total_frames() const {
+    return num_frames_ == all_frames_ ? frames_()->total_frames()
+                                      : num_frames_;
+  }
+  // Index of the first frame of a view in the underlying fragment.
+  size_t first_frame() const { return first_frame_; }
+  // See ReorderedFelixFrames::validate().
+  void validate() const { frames_()->validate(); }
 
   // The number of ADC values describing data beyond the header
   size_t total_adc_values() const {
@@ -456,126 +578,351 @@ class dune::FelixFragmentReordered : public dune::FelixFragmentBase {
   ReorderedFelixFrames const* frames_() const {
     return static_cast<dune::ReorderedFelixFrames const*>(artdaq_Fragment_);
   }
+
+  // Contiguous ADC row of a channel. Packed and compressed ADC sections are
+  // decoded row by row into a cache owned by the overlay on first access.
+  // Only the frames of the view are decoded.
+  adc_t const* row_(const uint8_t ch) const {
+    if (frames_()->header().adc_encoding == ReorderedFelixFrames::adc_raw16) {
+      return frames_()->channel_row(ch) + first_frame_;
+    }
+    return cache_.row(frames_(), ch, first_frame_, total_frames());
+  }
+  bool cached_row_(const uint8_t ch) const { return cache_.cached(ch); }
+  const FelixRowDecoder& decoder_() const { return cache_.decoder(frames_()); }
+
+  // Decoder and decoded rows of an encoded ADC section. Each is set up once
+  // under the lock and then published through an atomic flag, so the const
+  // accessors of one overlay may be called from several threads. Copies
+  // start empty.
+  class RowCache {
+   public:
+    RowCache() { reset_(); }
+    RowCache(const RowCache&) : RowCache() {}
+    RowCache& operator=(const RowCache&) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      reset_();
+      return *this;
+    }
+
+    const FelixRowDecoder& decoder(const ReorderedFelixFrames* frames) {
+      if (!decoder_ready_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        init_decoder_(frames);
+      }
+      return decoder_;
+    }
+    bool cached(const uint8_t ch) const {
+      return ready_[ch].load(std::memory_order_acquire);
+    }
+    // Row ch of frames [first, first + n), decoded on first use.
+    const adc_t* row(const ReorderedFelixFrames* frames, const uint8_t ch,
+                     const size_t first, const size_t n) {
+      if (!cached(ch)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!ready_[ch].load(std::memory_order_relaxed)) {
+          init_decoder_(frames);
+          if (rows_.empty()) rows_.resize(n * FelixFrame::num_ch_per_frame);
+          decoder_.decode_range(ch, first, n, rows_.data() + ch * n);
+          ready_[ch].store(true, std::memory_order_release);
+        }
+      }
+      return rows_.data() + ch * n;
+    }
+
+   private:
+    // Both need the lock.
+    void init_decoder_(const ReorderedFelixFrames* frames) {
+      if (decoder_ready_.load(std::memory_order_relaxed)) return;
+      decoder_.init(frames);
+      decoder_ready_.store(true, std::memory_order_release);
+    }
+    void reset_() {
+      decoder_ready_.store(false, std::memory_order_relaxed);
+      for (auto& r : ready_) r.store(false, std::memory_order_relaxed);
+      rows_.clear();
+    }
+
+    std::mutex mutex_;
+    std::atomic<bool> decoder_ready_;
+    FelixRowDecoder decoder_;
+    adc_v rows_;
+    std::atomic<bool> ready_[FelixFrame::num_ch_per_frame];
+  };
+
+  static constexpr size_t all_frames_ = size_t(-1);
+  size_t first_frame_ = 0;
+  size_t num_frames_ = all_frames_;
+
+  mutable RowCache cache_;
 };
 
 //======================
 // FELIX fragment class
 //======================
-class dune::FelixFragment: public FelixFragmentBase {
+// The layout is chosen once at construction. Both overlays are held by value
+// and all calls go to the concrete (final) classes, so accessors are
+// statically dispatched and can be inlined into per-ADC loops. No memory is
+// allocated per fragment.
+class dune::FelixFragment final : public FelixFragmentBase {
  public:
-  FelixFragment(const artdaq::Fragment& fragment, const bool reordered = 0): FelixFragmentBase(fragment) {
-    if (reordered) {
-      flxfrag = new FelixFragmentReordered(fragment);
-    } else {
-      flxfrag = new FelixFragmentUnordered(fragment);
+  // Reordered fragments of an unknown format version or encoding are
+  // rejected with a cet::exception.
+  FelixFragment(const artdaq::Fragment& fragment, const bool reordered = 0)
+      : FelixFragmentBase(fragment),
+        unord_(fragment),
+        reord_(fragment),
+        reordered_(reordered) {
+    if (reordered_) reord_.validate();
+  }
+  FelixFragment(const void* fragmentP, const size_t sizeBytes,
+                const bool reordered = 0)
+      : FelixFragmentBase(fragmentP, sizeBytes),
+        unord_(fragmentP, sizeBytes),
+        reord_(fragmentP, sizeBytes),
+        reordered_(reordered) {
+    if (reordered_) reord_.validate();
+  }
+
+  // Frames of an unordered fragment at the offsets of a frame table, see
+  // FelixFrameScanner. The table must outlive the overlay.
+  FelixFragment(const void* fragmentP, const size_t sizeBytes,
+                const std::vector<size_t>& frame_offsets)
+      : FelixFragment(fragmentP, sizeBytes, frame_offsets.data(),
+                      frame_offsets.size()) {}
+
+  // Whether the payload is in the reordered layout.
+  bool reordered() const { return reordered_; }
+  // Whether the payload is an array of back-to-back frames starting at
+  // data(), i.e. neither reordered nor indexed by a frame table.
+  bool contiguous() const { return !reordered_ && !unord_.frame_offsets(); }
+  // Frame frame_ID of an unordered fragment.
+  FelixFrame const* frame(const size_t frame_ID) const {
+    return unord_.frame(frame_ID);
+  }
+  // Index of the first frame within data(); only views of reordered
+  // fragments start past frame 0.
+  size_t first_frame() const { return reordered_ ? reord_.first_frame() : 0; }
+
+  // Zero-copy view of the frames with t_begin <= timestamp < t_end, found by
+  // binary search over the frame timestamps, which must be increasing. The
+  // view refers to the data of this fragment and has the same accessors,
+  // with frame 0 being the first frame in the window.
+  FelixFragment window(const uint64_t t_begin, const uint64_t t_end) const {
+    const size_t begin = lower_bound_(t_begin);
+    const size_t end = std::max(begin, lower_bound_(t_end));
+    return frame_range(begin, end - begin);
+  }
+  // Zero-copy view of num_frames frames starting at frame first.
+  FelixFragment frame_range(const size_t first, const size_t num_frames) const {
+    if (reordered_) {
+      return FelixFragment(artdaq_Fragment_, sizeBytes_, first_frame() + first,
+                           num_frames);
     }
+    if (unord_.frame_offsets()) {
+      return FelixFragment(artdaq_Fragment_, sizeBytes_,
+                           unord_.frame_offsets() + first, num_frames);
+    }
+    return FelixFragment(
+        static_cast<const FelixFrame*>(artdaq_Fragment_) + first,
+        num_frames * sizeof(FelixFrame));
   }
 
-  ~FelixFragment() { delete flxfrag; }
-
   /* Frame field and accessors. */
   uint8_t sof(const unsigned& frame_ID = 0) const {
-    return flxfrag->sof(frame_ID);
+    return reordered_ ? reord_.sof(frame_ID) : unord_.sof(frame_ID);
   }
   uint8_t version(const unsigned& frame_ID = 0) const {
-    return flxfrag->version(frame_ID);
+    return reordered_ ? reord_.version(frame_ID) : unord_.version(frame_ID);
   }
   uint8_t fiber_no(const unsigned& frame_ID = 0) const {
-    return flxfrag->fiber_no(frame_ID);
+    return reordered_ ? reord_.fiber_no(frame_ID) : unord_.fiber_no(frame_ID);
   }
   uint8_t slot_no(const unsigned& frame_ID = 0) const {
-    return flxfrag->slot_no(frame_ID);
+    return reordered_ ? reord_.slot_no(frame_ID) : unord_.slot_no(frame_ID);
   }
   uint8_t crate_no(const unsigned& frame_ID = 0) const {
-    return flxfrag->crate_no(frame_ID);
+    return reordered_ ? reord_.crate_no(frame_ID) : unord_.crate_no(frame_ID);
   }
   uint8_t mm(const unsigned& frame_ID = 0) const {
-    return flxfrag->mm(frame_ID);
+    return reordered_ ? reord_.mm(frame_ID) : unord_.mm(frame_ID);
   }
   uint8_t oos(const unsigned& frame_ID = 0) const {
-    return flxfrag->oos(frame_ID);
+    return reordered_ ? reord_.oos(frame_ID) : unord_.oos(frame_ID);
   }
   uint16_t wib_errors(const unsigned& frame_ID = 0) const {
-    return flxfrag->wib_errors(frame_ID);
+    return reordered_ ? reord_.wib_errors(frame_ID)
+                      : unord_.wib_errors(frame_ID);
   }
   uint64_t timestamp(const unsigned& frame_ID = 0) const {
-    return flxfrag->timestamp(frame_ID);
+    return reordered_ ? reord_.timestamp(frame_ID) : unord_.timestamp(frame_ID);
   }
   uint16_t wib_counter(const unsigned& frame_ID = 0) const {
-    return flxfrag->wib_counter(frame_ID);
+    return reordered_ ? reord_.wib_counter(frame_ID)
+                      : unord_.wib_counter(frame_ID);
   }
 
   /* Coldata block accessors. */
   uint8_t s1_error(const unsigned& frame_ID, const uint8_t& block_num) const {
-    return flxfrag->s1_error(frame_ID, block_num);
+    return reordered_ ? reord_.s1_error(frame_ID, block_num)
+                      : unord_.s1_error(frame_ID, block_num);
   }
   uint8_t s2_error(const unsigned& frame_ID, const uint8_t& block_num) const {
-    return flxfrag->s2_error(frame_ID, block_num);
+    return reordered_ ? reord_.s2_error(frame_ID, block_num)
+                      : unord_.s2_error(frame_ID, block_num);
   }
   uint16_t checksum_a(const unsigned& frame_ID,
                       const uint8_t& block_num) const {
-    return flxfrag->checksum_a(frame_ID, block_num);
+    return reordered_ ? reord_.checksum_a(frame_ID, block_num)
+                      : unord_.checksum_a(frame_ID, block_num);
   }
   uint16_t checksum_b(const unsigned& frame_ID,
                       const uint8_t& block_num) const {
-    return flxfrag->checksum_b(frame_ID, block_num);
+    return reordered_ ? reord_.checksum_b(frame_ID, block_num)
+                      : unord_.checksum_b(frame_ID, block_num);
   }
   uint16_t coldata_convert_count(const unsigned& frame_ID,
                                  const uint8_t& block_num) const {
-    return flxfrag->coldata_convert_count(frame_ID, block_num);
+    return reordered_ ? reord_.coldata_convert_count(frame_ID, block_num)
+                      : unord_.coldata_convert_count(frame_ID, block_num);
   }
   uint16_t error_register(const unsigned& frame_ID,
                           const uint8_t& block_num) const {
-    return flxfrag->error_register(frame_ID, block_num);
+    return reordered_ ? reord_.error_register(frame_ID, block_num)
+                      : unord_.error_register(frame_ID, block_num);
   }
   uint8_t hdr(const unsigned& frame_ID, const uint8_t& block_num,
               const uint8_t& hdr_num) const {
-    return flxfrag->hdr(frame_ID, block_num, hdr_num);
+    return reordered_ ? reord_.hdr(frame_ID, block_num, hdr_num)
+                      : unord_.hdr(frame_ID, block_num, hdr_num);
   }
 
   /* CRC32 */
   word_t CRC32(const unsigned& frame_ID = 0) const {
-    return flxfrag->CRC32(frame_ID);
+    return reordered_ ? reord_.CRC32(frame_ID) : unord_.CRC32(frame_ID);
   }
 
   // Functions to return a certain ADC value.
   adc_t get_ADC(const unsigned& frame_ID, const uint8_t block_ID,
                 const uint8_t channel_ID) const {
-    return flxfrag->get_ADC(frame_ID, block_ID, channel_ID);
+    return reordered_ ? reord_.get_ADC(frame_ID, block_ID, channel_ID)
+                      : unord_.get_ADC(frame_ID, block_ID, channel_ID);
   }
   adc_t get_ADC(const unsigned& frame_ID, const uint8_t channel_ID) const {
-    return flxfrag->get_ADC(frame_ID, channel_ID);
+    return reordered_ ? reord_.get_ADC(frame_ID, channel_ID)
+                      : unord_.get_ADC(frame_ID, channel_ID);
   }
 
   // Function to return all ADC values for a single channel.
   adc_v get_ADCs_by_channel(const uint8_t block_ID,
                             const uint8_t channel_ID) const {
-    return flxfrag->get_ADCs_by_channel(block_ID, channel_ID);
+    return reordered_ ? reord_.get_ADCs_by_channel(block_ID, channel_ID)
+                      : unord_.get_ADCs_by_channel(block_ID, channel_ID);
   }
   adc_v get_ADCs_by_channel(const uint8_t channel_ID) const {
-    return flxfrag->get_ADCs_by_channel(channel_ID);
+    return reordered_ ? reord_.get_ADCs_by_channel(channel_ID)
+                      : unord_.get_ADCs_by_channel(channel_ID);
+  }
+  void decode_channel(const uint8_t channel_ID, adc_t* out) const {
+    if (reordered_) {
+      reord_.decode_channel(channel_ID, out);
+    } else {
+      unord_.decode_channel(channel_ID, out);
+    }
   }
   // Function to return all ADC values for all channels in a map.
   std::map<uint8_t, adc_v> get_all_ADCs() const {
-    return flxfrag->get_all_ADCs();
+    return reordered_ ? reord_.get_all_ADCs() : unord_.get_all_ADCs();
+  }
+  // Function to decode all ADC values into a channel-major buffer.
+  void decode_all(adc_t* dst, const size_t stride) const {
+    if (reordered_) {
+      reord_.decode_all(dst, stride);
+    } else {
+      unord_.decode_all(dst, stride);
+    }
+  }
+  void decode_rows(adc_t* const* rows) const {
+    if (reordered_) {
+      reord_.decode_rows(rows);
+    } else {
+      unord_.decode_rows(rows);
+    }
   }
 
   // Function to print all timestamps.
-  void print_timestamps() const { return flxfrag->print_timestamps(); }
+  void print_timestamps() const {
+    return reordered_ ? reord_.print_timestamps() : unord_.print_timestamps();
+  }
 
-  void print(const unsigned i) const { return flxfrag->print(i); }
+  void print(const unsigned i) const {
+    return reordered_ ? reord_.print(i) : unord_.print(i);
+  }
 
-  void print_frames() const { return flxfrag->print_frames(); }
+  void print_frames() const {
+    return reordered_ ? reord_.print_frames() : unord_.print_frames();
+  }
 
   // The number of words in the current event minus the header.
-  size_t total_words() const { return flxfrag->total_words(); }
+  size_t total_words() const {
+    return reordered_ ? reord_.total_words() : unord_.total_words();
+  }
   // The number of frames in the current event.
-  size_t total_frames() const { return flxfrag->total_frames(); }
+  size_t total_frames() const {
+    return reordered_ ? reord_.total_frames() : unord_.total_frames();
+  }
   // The number of ADC values describing data beyond the header
-  size_t total_adc_values() const { return flxfrag->total_adc_values(); }
+  size_t total_adc_values() const {
+    return reordered_ ? reord_.total_adc_values() : unord_.total_adc_values();
+  }
 
  private:
-  const FelixFragmentBase* flxfrag;
+  // View of a reordered fragment.
+  FelixFragment(const void* fragmentP, const size_t sizeBytes,
+                const size_t first_frame, const size_t num_frames)
+      : FelixFragmentBase(fragmentP, sizeBytes),
+        unord_(fragmentP, sizeBytes),
+        reord_(fragmentP, sizeBytes, first_frame, num_frames),
+        reordered_(true) {}
+  // Unordered fragment with a frame table.
+  FelixFragment(const void* fragmentP, const size_t sizeBytes,
+                const size_t* frame_offsets, const size_t num_frames)
+      : FelixFragmentBase(fragmentP, sizeBytes),
+        unord_(fragmentP, sizeBytes, frame_offsets, num_frames),
+        reord_(fragmentP, sizeBytes),
+        reordered_(false) {}
+
+  // First frame whose timestamp is not before t.
+  size_t lower_bound_(const uint64_t t) const {
+    size_t lo = 0, hi = total_frames();
+    while (lo < hi) {
+      const size_t mid = lo + (hi - lo) / 2;
+      if (timestamp(mid) < t) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+  FelixFragmentUnordered unord_;
+  FelixFragmentReordered reord_;
+  bool reordered_;
 };
 
+namespace dune {
+
+// Copies the frames of an unordered fragment, e.g. one indexed by a frame
+// table, into a contiguous array.
+inline std::vector<FelixFrame> gather_frames(const FelixFragment& fragment) {
+  std::vector<FelixFrame> frames(fragment.total_frames());
+  for (size_t i = 0; i < frames.size(); ++i) {
+    memcpy(&frames[i], fragment.frame(i), sizeof(FelixFrame));
+  }
+  return frames;
+}
+
+}  // namespace dune
+
 #endif /* artdaq_dune_Overlays_FelixFragment_hh */
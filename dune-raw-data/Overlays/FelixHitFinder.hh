@@ -0,0 +1,221 @@
+// FelixHitFinder.hh
+// Online pedestal subtraction and threshold hit finding on FELIX data.
+
+#ifndef artdaq_dune_Overlays_FelixHitFinder_hh
+#define artdaq_dune_Overlays_FelixHitFinder_hh
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "dune-raw-data/Overlays/FelixDecode.hh"
+#include "dune-raw-data/Overlays/FelixFormat.hh"
+#include "dune-raw-data/Overlays/FelixFragment.hh"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace dune {
+
+// A pulse on one channel: a run of consecutive ticks whose pedestal
+// subtracted ADC value lies above the threshold.
+struct FelixHit {
+  uint16_t channel;             // Frame channel (0-255).
+  uint64_t start_tick;          // First tick above threshold.
+  uint32_t time_over_threshold; // Number of ticks above threshold.
+  uint16_t peak;                // Largest pedestal subtracted value.
+  uint32_t integral;            // Sum of the pedestal subtracted values.
+};
+
+// Trigger primitive finder for one FELIX link. Every channel keeps a running
+// pedestal estimate, a frugal median that moves one ADC count towards each
+// sample that is not part of a hit. Samples more than threshold counts above
+// the pedestal form hits, which are emitted once the channel falls back
+// below threshold.
+//
+// Frames are unpacked in L1-resident tiles and every frame is processed
+// 16 channels at a time with AVX2 (8 with SSE2): pedestal update and
+// threshold comparison are branch-free, and only the lanes that are in a
+// hit are handled one by one. State carries over between calls, so a link
+// can be fed batch by batch; ticks count the frames seen since the start.
+class FelixHitFinder {
+ public:
+  static constexpr unsigned num_channels = FelixFrame::num_ch_per_frame;
+
+  explicit FelixHitFinder(const adc_t threshold) : threshold_(threshold) {
+    reset();
+  }
+
+  // Forgets all pedestals and open hits and restarts the tick count. The
+  // pedestals are seeded with the samples of the next frame.
+  void reset(const uint64_t first_tick = 0) {
+    tick_ = first_tick;
+    primed_ = false;
+    memset(pedestal_, 0, sizeof(pedestal_));
+    memset(in_hit_, 0, sizeof(in_hit_));
+  }
+
+  adc_t threshold() const { return threshold_; }
+  // Tick of the next frame.
+  uint64_t tick() const { return tick_; }
+  adc_t pedestal(const unsigned ch) const { return pedestal_[ch]; }
+  void set_pedestal(const unsigned ch, const adc_t pedestal) {
+    pedestal_[ch] = pedestal;
+    primed_ = true;
+  }
+
+  // Processes num_frames consecutive frames and appends the hits that end
+  // within them to hits.
+  void process(const FelixFrame* frames, const size_t num_frames,
+               std::vector<FelixHit>& hits) {
+    alignas(64) adc_t tile[felix_decode_tile_frames * num_channels];
+    for (size_t fr0 = 0; fr0 < num_frames; fr0 += felix_decode_tile_frames) {
+      const size_t n = std::min(felix_decode_tile_frames, num_frames - fr0);
+      for (size_t i = 0; i < n; ++i) {
+        frames[fr0 + i].unpack_all(tile + i * num_channels);
+      }
+      for (size_t i = 0; i < n; ++i) {
+        process_frame_(tile + i * num_channels, hits);
+      }
+    }
+  }
+
+  // Same for all frames of a fragment, in either layout. Reordered and
+  // table-indexed fragments are decoded and transposed back to frame-major
+  // tiles.
+  void process(const FelixFragment& fragment, std::vector<FelixHit>& hits) {
+    const size_t num_frames = fragment.total_frames();
+    if (fragment.contiguous()) {
+      process(static_cast<const FelixFrame*>(fragment.data()), num_frames,
+              hits);
+      return;
+    }
+    adc_v rows(num_channels * num_frames);
+    fragment.decode_all(rows.data(), num_frames);
+    alignas(64) adc_t tile[felix_decode_tile_frames * num_channels];
+    for (size_t fr0 = 0; fr0 < num_frames; fr0 += felix_decode_tile_frames) {
+      const size_t n = std::min(felix_decode_tile_frames, num_frames - fr0);
+      gather_tile(rows.data() + fr0, num_frames, n, tile);
+      for (size_t i = 0; i < n; ++i) {
+        process_frame_(tile + i * num_channels, hits);
+      }
+    }
+  }
+
+  // Closes the hits that are still open, e.g. at the end of a run.
+  void flush(std::vector<FelixHit>& hits) {
+    for (unsigned ch = 0; ch < num_channels; ++ch) {
+      if (in_hit_[ch]) {
+        hits.push_back(open_[ch]);
+        in_hit_[ch] = 0;
+      }
+    }
+  }
+
+ private:
+  void process_frame_(const adc_t* adc, std::vector<FelixHit>& hits) {
+    if (!primed_) {
+      memcpy(pedestal_, adc, sizeof(pedestal_));
+      primed_ = true;
+    }
+    unsigned ch = 0;
+#if defined(__AVX2__)
+    const __m256i thr = _mm256_set1_epi16(threshold_);
+    for (; ch < num_channels; ch += 16) {
+      const __m256i a =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(adc + ch));
+      __m256i* pp = reinterpret_cast<__m256i*>(pedestal_ + ch);
+      const __m256i p = _mm256_loadu_si256(pp);
+      const __m256i above = _mm256_cmpgt_epi16(_mm256_sub_epi16(a, p), thr);
+      // Outside hits the pedestal steps by -1, 0 or +1 towards the sample.
+      const __m256i step = _mm256_sub_epi16(_mm256_cmpgt_epi16(p, a),
+                                            _mm256_cmpgt_epi16(a, p));
+      _mm256_storeu_si256(
+          pp, _mm256_add_epi16(p, _mm256_andnot_si256(above, step)));
+      const __m256i active = _mm256_or_si256(
+          above,
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in_hit_ + ch)));
+      const uint32_t mask = _mm256_movemask_epi8(active);
+      if (mask) update_lanes_(ch, mask, above, adc, p, hits);
+    }
+#elif defined(__SSE2__)
+    const __m128i thr = _mm_set1_epi16(threshold_);
+    for (; ch < num_channels; ch += 8) {
+      const __m128i a =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(adc + ch));
+      __m128i* pp = reinterpret_cast<__m128i*>(pedestal_ + ch);
+      const __m128i p = _mm_loadu_si128(pp);
+      const __m128i above = _mm_cmpgt_epi16(_mm_sub_epi16(a, p), thr);
+      const __m128i step =
+          _mm_sub_epi16(_mm_cmpgt_epi16(p, a), _mm_cmpgt_epi16(a, p));
+      _mm_storeu_si128(pp, _mm_add_epi16(p, _mm_andnot_si128(above, step)));
+      const __m128i active = _mm_or_si128(
+          above,
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(in_hit_ + ch)));
+      const uint32_t mask = _mm_movemask_epi8(active);
+      if (mask) update_lanes_(ch, mask, above, adc, p, hits);
+    }
+#endif
+    for (; ch < num_channels; ++ch) {
+      const int16_t p = pedestal_[ch];
+      const int16_t a = adc[ch];
+      const bool above = a - p > threshold_;
+      if (!above) pedestal_[ch] += (a > p) - (a < p);
+      if (above || in_hit_[ch]) update_(ch, above, a - p, hits);
+    }
+    ++tick_;
+  }
+
+#if defined(__SSE2__)
+  // Handles the lanes of a vector of channels starting at ch that are above
+  // threshold or in a hit; mask holds two bits per active lane.
+  template <typename Vec>
+  void update_lanes_(const unsigned ch, uint32_t mask, const Vec& above,
+                     const adc_t* adc, const Vec& p,
+                     std::vector<FelixHit>& hits) {
+    alignas(32) int16_t ab[sizeof(Vec) / 2];
+    alignas(32) int16_t ped[sizeof(Vec) / 2];
+    memcpy(ab, &above, sizeof(Vec));
+    memcpy(ped, &p, sizeof(Vec));
+    while (mask) {
+      const unsigned j = __builtin_ctz(mask) / 2;
+      mask &= ~(3u << 2 * j);
+      update_(ch + j, ab[j], int16_t(adc[ch + j]) - ped[j], hits);
+    }
+  }
+#endif
+
+  void update_(const unsigned ch, const bool above, const int value,
+               std::vector<FelixHit>& hits) {
+    FelixHit& hit = open_[ch];
+    if (above) {
+      if (!in_hit_[ch]) {
+        in_hit_[ch] = -1;
+        hit = FelixHit{uint16_t(ch), tick_, 0, 0, 0};
+      }
+      ++hit.time_over_threshold;
+      hit.peak = std::max<int>(hit.peak, value);
+      hit.integral += value;
+    } else {
+      hits.push_back(hit);
+      in_hit_[ch] = 0;
+    }
+  }
+
+  const int16_t threshold_;
+  uint64_t tick_;
+  bool primed_;
+  alignas(32) int16_t pedestal_[num_channels];
+  // All ones for channels that are in a hit.
+  alignas(32) int16_t in_hit_[num_channels];
+  FelixHit open_[num_channels];
+};
+
+}  // namespace dune
+
+#endif /* artdaq_dune_Overlays_FelixHitFinder_hh */
@@ -0,0 +1,353 @@
+// FelixMonitor.hh
+// Streaming per-channel ADC statistics and histograms of FELIX links.
+
+#ifndef artdaq_dune_Overlays_FelixMonitor_hh
+#define artdaq_dune_Overlays_FelixMonitor_hh
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "dune-raw-data/Overlays/FelixDecode.hh"
+#include "dune-raw-data/Overlays/FelixFormat.hh"
+#include "dune-raw-data/Overlays/FelixFragment.hh"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace dune {
+
+// Accumulates, for each of the 256 channels of a link, the number of
+// samples, mean, RMS, minimum and maximum ADC value and a histogram with one
+// bin per 12-bit ADC code.
+//
+// Any number of threads may ingest fragments concurrently. Every thread
+// accumulates into a partial of its own, so ingest never takes a lock (but
+// for the first call of a thread, which registers its partial). Per
+// fragment, exact integer sums are gathered with SIMD across channels and
+// then folded into the running mean and variance with the parallel form of
+// Welford's algorithm. snapshot() merges the partials the same way while
+// ingest goes on: the statistics of a partial are published under a
+// sequence counter, so a snapshot sees whole fragments only; histogram bins
+// are read as they are, so they may already include samples of fragments
+// that are still being ingested.
+class FelixMonitor {
+ public:
+  static constexpr unsigned num_channels = FelixFrame::num_ch_per_frame;
+  static constexpr unsigned num_bins = 4096;
+
+  struct ChannelStats {
+    uint64_t count;
+    double mean;
+    double rms;
+    adc_t min;
+    adc_t max;
+  };
+
+  // Merged state of all partials at the time of snapshot().
+  struct Snapshot {
+    std::vector<ChannelStats> channels;
+    std::vector<uint64_t> histograms;
+
+    const ChannelStats& channel(const unsigned ch) const {
+      return channels[ch];
+    }
+    // The num_bins bins of the channel.
+    const uint64_t* histogram(const unsigned ch) const {
+      return histograms.data() + ch * num_bins;
+    }
+  };
+
+  FelixMonitor() : id_(next_id_()) {}
+
+  FelixMonitor(const FelixMonitor&) = delete;
+  FelixMonitor& operator=(const FelixMonitor&) = delete;
+
+  void ingest(const FelixFrame* frames, const size_t num_frames) {
+    Partial& p = partial_();
+    Batch batch;
+    alignas(64) adc_t tile[felix_decode_tile_frames * num_channels];
+    for (size_t fr0 = 0; fr0 < num_frames; fr0 += felix_decode_tile_frames) {
+      const size_t n = std::min(felix_decode_tile_frames, num_frames - fr0);
+      for (size_t i = 0; i < n; ++i) {
+        frames[fr0 + i].unpack_all(tile + i * num_channels);
+      }
+      accumulate_tile_(tile, n, batch, p);
+    }
+    publish_(batch, num_frames, p);
+  }
+
+  // Same for all frames of a fragment, in either layout. Reordered and
+  // table-indexed fragments are decoded and transposed back to frame-major
+  // tiles.
+  void ingest(const FelixFragment& fragment) {
+    const size_t num_frames = fragment.total_frames();
+    if (fragment.contiguous()) {
+      ingest(static_cast<const FelixFrame*>(fragment.data()), num_frames);
+      return;
+    }
+    Partial& p = partial_();
+    adc_v rows(num_channels * num_frames);
+    fragment.decode_all(rows.data(), num_frames);
+    Batch batch;
+    alignas(64) adc_t tile[felix_decode_tile_frames * num_channels];
+    for (size_t fr0 = 0; fr0 < num_frames; fr0 += felix_decode_tile_frames) {
+      const size_t n = std::min(felix_decode_tile_frames, num_frames - fr0);
+      gather_tile(rows.data() + fr0, num_frames, n, tile);
+      accumulate_tile_(tile, n, batch, p);
+    }
+    publish_(batch, num_frames, p);
+  }
+
+  Snapshot snapshot() const {
+    Snapshot snap;
+    snap.histograms.assign(num_channels * num_bins, 0);
+    std::vector<Stats> merged(num_channels);
+    std::vector<Stats> stats(num_channels);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& p : partials_) {
+      read_(*p, stats);
+      for (unsigned ch = 0; ch < num_channels; ++ch) {
+        merged[ch].merge(stats[ch]);
+      }
+      for (size_t b = 0; b < snap.histograms.size(); ++b) {
+        snap.histograms[b] += p->histograms[b].load(std::memory_order_relaxed);
+      }
+    }
+    snap.channels.resize(num_channels);
+    for (unsigned ch = 0; ch < num_channels; ++ch) {
+      const Stats& s = merged[ch];
+      snap.channels[ch] = ChannelStats{
+          s.count, s.mean, s.count ? std::sqrt(s.m2 / s.count) : 0.,
+          s.count ? s.min : adc_t(0), s.count ? s.max : adc_t(0)};
+    }
+    return snap;
+  }
+
+ private:
+  // Running statistics of one channel.
+  struct Stats {
+    uint64_t count = 0;
+    double mean = 0;
+    double m2 = 0;  // Sum of squared deviations from the mean.
+    adc_t min = 0xffff;
+    adc_t max = 0;
+
+    // Chan et al.'s pairwise update of the Welford state.
+    void merge(const Stats& o) {
+      if (!o.count) return;
+      const uint64_t n = count + o.count;
+      const double delta = o.mean - mean;
+      mean += delta * o.count / n;
+      m2 += o.m2 + delta * delta * count / n * o.count;
+      count = n;
+      min = std::min(min, o.min);
+      max = std::max(max, o.max);
+    }
+  };
+
+  // Exact sums of one fragment.
+  struct Batch {
+    uint64_t sum[num_channels] = {};
+    uint64_t sum_sq[num_channels] = {};
+    adc_t min[num_channels];
+    adc_t max[num_channels] = {};
+
+    Batch() { std::fill(min, min + num_channels, 0xffff); }
+  };
+
+  // Accumulator of one ingesting thread. Only that thread writes to it.
+  struct Partial {
+    Partial()
+        : histograms(new std::atomic<uint64_t>[num_channels * num_bins]()) {}
+
+    // Statistics of the thread, private to it.
+    Stats stats[num_channels];
+
+    // Published copy of stats, under a sequence counter that is odd while
+    // an update is in progress.
+    std::atomic<uint64_t> seq{0};
+    std::atomic<uint64_t> count[num_channels];
+    std::atomic<double> mean[num_channels];
+    std::atomic<double> m2[num_channels];
+    std::atomic<uint32_t> min_max[num_channels];
+
+    // 64-bit like the sample counts: a 32-bit bin of a flat channel wraps
+    // after about 2^32 / 2 MHz = 36 minutes.
+    std::unique_ptr<std::atomic<uint64_t>[]> histograms;
+  };
+
+  static uint64_t next_id_() {
+    static std::atomic<uint64_t> id(0);
+    return id++;
+  }
+
+  // Partial of the calling thread, registered on first use. Monitors are
+  // told apart by id rather than by address, which may be reused.
+  Partial& partial_() {
+    thread_local std::map<uint64_t, Partial*> mine;
+    auto it = mine.find(id_);
+    if (it != mine.end()) return *it->second;
+    std::lock_guard<std::mutex> lock(mutex_);
+    partials_.emplace_back(new Partial);
+    Partial& p = *partials_.back();
+    for (unsigned ch = 0; ch < num_channels; ++ch) {
+      p.count[ch].store(0, std::memory_order_relaxed);
+      p.mean[ch].store(0, std::memory_order_relaxed);
+      p.m2[ch].store(0, std::memory_order_relaxed);
+      p.min_max[ch].store(0xffff, std::memory_order_relaxed);
+    }
+    mine[id_] = &p;
+    return p;
+  }
+
+  // Adds a frame-major tile of n frames to the sums of the batch and to the
+  // histograms of the partial.
+  static void accumulate_tile_(const adc_t* tile, const size_t n,
+                               Batch& batch, Partial& p) {
+    // 32-bit sums of squares cannot overflow within a tile.
+    uint32_t sum[num_channels] = {};
+    uint32_t sum_sq[num_channels] = {};
+    for (size_t i = 0; i < n; ++i) {
+      const adc_t* adc = tile + i * num_channels;
+      unsigned ch = 0;
+#if defined(__AVX2__)
+      for (; ch < num_channels; ch += 16) {
+        const __m256i a =
+            _mm256_loadu_si256(reinterpret_cast<const __m256i*>(adc + ch));
+        __m256i* mn = reinterpret_cast<__m256i*>(batch.min + ch);
+        __m256i* mx = reinterpret_cast<__m256i*>(batch.max + ch);
+        _mm256_storeu_si256(mn, _mm256_min_epu16(_mm256_loadu_si256(mn), a));
+        _mm256_storeu_si256(mx, _mm256_max_epu16(_mm256_loadu_si256(mx), a));
+        for (unsigned h = 0; h < 2; ++h) {
+          const __m256i a32 = _mm256_cvtepu16_epi32(
+              h ? _mm256_extracti128_si256(a, 1) : _mm256_castsi256_si128(a));
+          __m256i* s = reinterpret_cast<__m256i*>(sum + ch + 8 * h);
+          __m256i* sq = reinterpret_cast<__m256i*>(sum_sq + ch + 8 * h);
+          _mm256_storeu_si256(s, _mm256_add_epi32(_mm256_loadu_si256(s), a32));
+          _mm256_storeu_si256(
+              sq, _mm256_add_epi32(_mm256_loadu_si256(sq),
+                                   _mm256_mullo_epi32(a32, a32)));
+        }
+      }
+#elif defined(__SSE2__)
+      const __m128i zero = _mm_setzero_si128();
+      const __m128i bias = _mm_set1_epi16(-0x8000);
+      for (; ch < num_channels; ch += 8) {
+        const __m128i a =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(adc + ch));
+        // SSE2 only has signed 16-bit min/max; ADC values are below 2^15.
+        __m128i* mn = reinterpret_cast<__m128i*>(batch.min + ch);
+        __m128i* mx = reinterpret_cast<__m128i*>(batch.max + ch);
+        _mm_storeu_si128(
+            mn, _mm_xor_si128(_mm_min_epi16(_mm_xor_si128(_mm_loadu_si128(mn),
+                                                          bias),
+                                            _mm_xor_si128(a, bias)),
+                              bias));
+        _mm_storeu_si128(mx, _mm_max_epi16(_mm_loadu_si128(mx), a));
+        const __m128i lo = _mm_mullo_epi16(a, a);
+        const __m128i hi = _mm_mulhi_epu16(a, a);
+        __m128i* s = reinterpret_cast<__m128i*>(sum + ch);
+        __m128i* sq = reinterpret_cast<__m128i*>(sum_sq + ch);
+        _mm_storeu_si128(s, _mm_add_epi32(_mm_loadu_si128(s),
+                                          _mm_unpacklo_epi16(a, zero)));
+        _mm_storeu_si128(s + 1, _mm_add_epi32(_mm_loadu_si128(s + 1),
+                                              _mm_unpackhi_epi16(a, zero)));
+        _mm_storeu_si128(sq, _mm_add_epi32(_mm_loadu_si128(sq),
+                                           _mm_unpacklo_epi16(lo, hi)));
+        _mm_storeu_si128(sq + 1, _mm_add_epi32(_mm_loadu_si128(sq + 1),
+                                               _mm_unpackhi_epi16(lo, hi)));
+      }
+#endif
+      for (; ch < num_channels; ++ch) {
+        const uint32_t a = adc[ch];
+        batch.min[ch] = std::min<adc_t>(batch.min[ch], a);
+        batch.max[ch] = std::max<adc_t>(batch.max[ch], a);
+        sum[ch] += a;
+        sum_sq[ch] += a * a;
+      }
+      // Only this thread writes the bins, so a plain load and store suffice.
+      std::atomic<uint64_t>* h = p.histograms.get();
+      for (ch = 0; ch < num_channels; ++ch, h += num_bins) {
+        std::atomic<uint64_t>& bin = h[adc[ch] & (num_bins - 1)];
+        bin.store(bin.load(std::memory_order_relaxed) + 1,
+                  std::memory_order_relaxed);
+      }
+    }
+    for (unsigned ch = 0; ch < num_channels; ++ch) {
+      batch.sum[ch] += sum[ch];
+      batch.sum_sq[ch] += sum_sq[ch];
+    }
+  }
+
+  // Folds the sums of a fragment into the statistics of the partial and
+  // publishes them.
+  static void publish_(const Batch& batch, const size_t num_frames,
+                       Partial& p) {
+    if (!num_frames) return;
+    for (unsigned ch = 0; ch < num_channels; ++ch) {
+      Stats b;
+      b.count = num_frames;
+      b.mean = double(batch.sum[ch]) / num_frames;
+      // With sum = q*n + r, m2 = sum_sq - sum^2/n = (sum_sq - q*sum) - r*sum/n,
+      // where the first term is exact in integers.
+      const uint64_t q = batch.sum[ch] / num_frames;
+      const uint64_t r = batch.sum[ch] % num_frames;
+      b.m2 = double(batch.sum_sq[ch] - q * batch.sum[ch]) -
+             double(r) * batch.sum[ch] / num_frames;
+      b.min = batch.min[ch];
+      b.max = batch.max[ch];
+      p.stats[ch].merge(b);
+    }
+    const uint64_t seq = p.seq.load(std::memory_order_relaxed);
+    p.seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (unsigned ch = 0; ch < num_channels; ++ch) {
+      const Stats& s = p.stats[ch];
+      p.count[ch].store(s.count, std::memory_order_relaxed);
+      p.mean[ch].store(s.mean, std::memory_order_relaxed);
+      p.m2[ch].store(s.m2, std::memory_order_relaxed);
+      p.min_max[ch].store(uint32_t(s.max) << 16 | s.min,
+                          std::memory_order_relaxed);
+    }
+    p.seq.store(seq + 2, std::memory_order_release);
+  }
+
+  // Reads the published statistics of a partial, retrying if they change
+  // while being read.
+  static void read_(const Partial& p, std::vector<Stats>& stats) {
+    uint64_t before, after;
+    do {
+      before = p.seq.load(std::memory_order_acquire);
+      for (unsigned ch = 0; ch < num_channels; ++ch) {
+        Stats& s = stats[ch];
+        s.count = p.count[ch].load(std::memory_order_relaxed);
+        s.mean = p.mean[ch].load(std::memory_order_relaxed);
+        s.m2 = p.m2[ch].load(std::memory_order_relaxed);
+        const uint32_t min_max = p.min_max[ch].load(std::memory_order_relaxed);
+        s.min = min_max & 0xffff;
+        s.max = min_max >> 16;
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after = p.seq.load(std::memory_order_relaxed);
+    } while (before != after || before % 2);
+  }
+
+  const uint64_t id_;
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<Partial> > partials_;
+};
+
+}  // namespace dune
+
+#endif /* artdaq_dune_Overlays_FelixMonitor_hh */
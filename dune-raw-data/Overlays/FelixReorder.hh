@@ -4,15 +4,20 @@
 #ifndef artdaq_dune_Overlays_FelixReorder_hh
 #define artdaq_dune_Overlays_FelixReorder_hh
 
+#include <algorithm>
 #include <chrono>
+#include <cstring>
 #include <fstream>
 #include <thread>
+#include <utility>
 #include <vector>
 
 #include "artdaq-core/Data/Fragment.hh"
+#include "cetlib/exception.h"
+#include "dune-raw-data/Overlays/FelixCompress.hh"
+#include "dune-raw-data/Overlays/FelixDecode.hh"
 #include "dune-raw-data/Overlays/FelixFormat.hh"
-
-#define NUMBER_THREADS 6
+#include "dune-raw-data/Overlays/FelixThreadPool.hh"
 
 namespace dune {
 
@@ -36,10 +41,17 @@ class FelixReorderer {
   static const unsigned num_adcs_per_stream =
       num_adcs_per_block / num_streams_per_block;
 
+  // Smallest number of frames handed to a single ADC copy task. Shorter
+  // windows are reordered on the calling thread only. Tasks always start on
+  // a decode tile boundary.
+  static const unsigned min_frames_per_task = 256;
+
  private:
   const uint8_t* head;
   const size_t num_frames;
   const size_t size = num_frames * frame_size;
+  FelixThreadPool* pool;
+  const ReorderedFelixFrames::AdcEncoding encoding;
 
   uint16_t initial_adcs[num_adcs_per_frame];
 
@@ -50,38 +62,237 @@ class FelixReorderer {
   void adc_copy(uint8_t* dest);
 
  public:
-  FelixReorderer(const uint8_t* data, const size_t& num_frames = 10000)
-      : head(data), num_frames(num_frames){};
+  // The ADC copy runs on the given pool, or on the pool of the shared
+  // FelixReorderEngine if none is given. The ADC section is written in the
+  // given fixed-size encoding.
+  FelixReorderer(const uint8_t* data, const size_t& num_frames = 10000,
+                 FelixThreadPool* pool = nullptr,
+                 const ReorderedFelixFrames::AdcEncoding encoding =
+                     ReorderedFelixFrames::adc_raw16)
+      : head(data), num_frames(num_frames), pool(pool), encoding(encoding){};
 
-  const unsigned newSize =
-      netio_header_size +
-      (wib_header_size + coldata_header_size * num_blocks_per_frame +
-       crc32_size + adc_size * num_adcs_per_frame) *
-          num_frames;
+  // Layout header of the destination buffer.
+  const ReorderedFelixFrames::Header layout =
+      ReorderedFelixFrames::layout(num_frames, encoding);
+
+  const unsigned newSize = ReorderedFelixFrames::size_bytes(layout);
 
   // Locations in the destination buffer.
-  const unsigned wib_headers_begin = netio_header_size;
-  const unsigned crc32_begin = wib_headers_begin + num_frames * wib_header_size;
-  const unsigned coldata_headers_begin = crc32_begin + num_frames * crc32_size;
-  const unsigned adc_begin =
-      coldata_headers_begin +
-      num_frames * coldata_header_size * num_blocks_per_frame;
-  const unsigned end =
-      adc_begin + (num_frames - 1) * num_adcs_per_frame * adc_size;
+  const unsigned wib_headers_begin = layout.wib_headers_offset;
+  const unsigned crc32_begin = layout.crc32_offset;
+  const unsigned coldata_headers_begin = layout.coldata_headers_offset;
+  const unsigned adc_begin = layout.adc_offset;
 
   void reorder_copy(uint8_t* dest);
   friend void t_adc_copy_by_tick(FelixReorderer* reord, uint8_t* dest,
                                  const unsigned& t_inst, const unsigned& t_tot);
   friend void t_adc_copy_by_channel(FelixReorderer* reord, uint8_t* dest,
-                                    const unsigned& t_inst,
-                                    const unsigned& t_tot);
-  void single_frame_from_buffer(const uint8_t* src, uint8_t* dest,
-                                const size_t& i);
-  void frames_from_buffer(const uint8_t* src, uint8_t* dest,
-                          const size_t& num_frames);
+                                    const size_t& fr_begin,
+                                    const size_t& fr_end);
+  friend void t_adc_copy_tiled(FelixReorderer* reord, uint8_t* dest,
+                               const size_t& fr_begin, const size_t& fr_end);
+  friend void t_adc_copy_packed(FelixReorderer* reord, uint8_t* dest,
+                                const size_t& fr_begin, const size_t& fr_end);
+  friend class FelixStreamReorderer;
 };
 
-void FelixReorderer::wib_header_copy(uint8_t* dest) {
+// Reorders fragments on a persistent pool of worker threads. One engine can
+// be shared by all fragments and links of a board reader, so threads are
+// created once instead of on every reorder.
+class FelixReorderEngine {
+ public:
+  static const unsigned default_num_threads = 6;
+
+  // num_threads is the total number of threads that work on a reorder,
+  // including the calling one. Workers are pinned to the given cores if cpus
+  // is not empty.
+  explicit FelixReorderEngine(
+      const unsigned num_threads = default_num_threads,
+      const std::vector<int>& cpus = std::vector<int>())
+      : pool_(num_threads, cpus) {}
+
+  // Reorders num_frames frames from src into dest, which must hold
+  // ReorderedFelixFrames::size_bytes(
+  //     ReorderedFelixFrames::layout(num_frames, encoding))
+  // bytes.
+  void reorder(const uint8_t* src, const size_t num_frames, uint8_t* dest,
+               const ReorderedFelixFrames::AdcEncoding encoding =
+                   ReorderedFelixFrames::adc_raw16) {
+    FelixReorderer reorderer(src, num_frames, &pool_, encoding);
+    reorderer.reorder_copy(dest);
+  }
+  artdaq::Fragment reorder(const uint8_t* src, const size_t num_frames,
+                           const ReorderedFelixFrames::AdcEncoding encoding =
+                               ReorderedFelixFrames::adc_raw16) {
+    FelixReorderer reorderer(src, num_frames, &pool_, encoding);
+    artdaq::Fragment result;
+    result.resizeBytes(reorderer.newSize);
+    reorderer.reorder_copy(result.dataBeginBytes());
+    return result;
+  }
+
+  // Rebuilds the raw frames of a reordered, possibly compressed, fragment at
+  // src; the inverse of reorder(). dest must hold total_frames() frames. The
+  // frames are bit-identical to the ones that were reordered.
+  void restore(const uint8_t* src, uint8_t* dest) {
+    const ReorderedFelixFrames* frames =
+        reinterpret_cast<const ReorderedFelixFrames*>(src);
+    frames->validate();
+    const ReorderedFelixFrames::Header& h = frames->header();
+    const size_t num_frames = h.num_frames;
+
+    // Raw rows are packed in place, other encodings are decoded first.
+    const adc_t* rows = nullptr;
+    size_t stride = h.adc_row_stride;
+    adc_v decoded;
+    if (h.adc_encoding == ReorderedFelixFrames::adc_raw16) {
+      rows = frames->channel_row(0);
+    } else {
+      decoded.resize(num_frames * FelixFrame::num_ch_per_frame);
+      const FelixRowDecoder decoder(frames);
+      pool_.parallel_for(FelixFrame::num_ch_per_frame, [&](size_t ch) {
+        decoder.decode_row(ch, num_frames, decoded.data() + ch * num_frames);
+      });
+      rows = decoded.data();
+      stride = num_frames;
+    }
+
+    const size_t num_tasks = std::max<size_t>(
+        1, std::min<size_t>(2 * pool_.size(),
+                            num_frames / FelixReorderer::min_frames_per_task));
+    const size_t frames_per_task = (num_frames + num_tasks - 1) / num_tasks;
+    pool_.parallel_for(num_tasks, [&](size_t i) {
+      const size_t fr_begin = i * frames_per_task;
+      const size_t fr_end = std::min(fr_begin + frames_per_task, num_frames);
+      if (fr_begin >= fr_end) return;
+      restore_headers_(frames, fr_begin, fr_end, dest);
+      pack_frames(rows + fr_begin, stride, fr_end - fr_begin,
+                  reinterpret_cast<FelixFrame*>(dest) + fr_begin);
+    });
+  }
+  artdaq::Fragment restore(const artdaq::Fragment& reordered) {
+    const ReorderedFelixFrames* frames =
+        reinterpret_cast<const ReorderedFelixFrames*>(
+            reordered.dataBeginBytes());
+    artdaq::Fragment result;
+    result.resizeBytes(frames->total_frames() * sizeof(FelixFrame));
+    restore(reordered.dataBeginBytes(), result.dataBeginBytes());
+    return result;
+  }
+
+  FelixThreadPool& pool() { return pool_; }
+
+  // Engine used by FelixReorder() and by reorderers without their own pool.
+  static FelixReorderEngine& shared() {
+    static FelixReorderEngine engine;
+    return engine;
+  }
+
+ private:
+  // Copies the WIB headers, COLDATA headers and CRC words of frames
+  // [fr_begin, fr_end) back into their frames, expanding compact headers.
+  static void restore_headers_(const ReorderedFelixFrames* frames,
+                               const size_t fr_begin, const size_t fr_end,
+                               uint8_t* dest) {
+    typedef FelixReorderer R;
+    for (size_t i = fr_begin; i < fr_end; ++i) {
+      uint8_t* frame = dest + i * R::frame_size;
+      const WIBHeader wib = frames->wib_header(i);
+      memcpy(frame, &wib, R::wib_header_size);
+      for (unsigned j = 0; j < R::num_blocks_per_frame; ++j) {
+        const ColdataHeader bhead = frames->coldata_header(i, j);
+        memcpy(frame + R::wib_header_size + j * R::coldata_block_size, &bhead,
+               R::coldata_header_size);
+      }
+      const word_t crc = frames->CRC32(i);
+      memcpy(frame + R::frame_size - R::crc32_size, &crc, R::crc32_size);
+    }
+  }
+
+  FelixThreadPool pool_;
+};
+
+// Reorders frames into a fragment while they arrive, e.g. one DMA block at a
+// time, so that most of the reordering overlaps with readout and the frames
+// never have to be gathered into one contiguous buffer. The fragment is laid
+// out for max_frames frames up front; every chunk is written straight into
+// its final slots, and finish() only records how many frames arrived.
+//
+// Row padding and the slots of frames that never arrived are not cleared.
+// The ADC rows are written with streaming stores for any chunk length: the
+// ticks before the first 64-byte boundary of each row use plain stores.
+class FelixStreamReorderer {
+ public:
+  // The ADC copy runs on the given pool, or on the pool of the shared
+  // FelixReorderEngine if none is given.
+  explicit FelixStreamReorderer(const size_t max_frames,
+                                FelixThreadPool* pool = nullptr)
+      : layout_(ReorderedFelixFrames::layout(max_frames)),
+        max_frames_(max_frames),
+        pool_(pool ? *pool : FelixReorderEngine::shared().pool()) {
+    fragment_.resizeBytes(ReorderedFelixFrames::size_bytes(layout_));
+    layout_.num_frames = 0;
+  }
+
+  // Reorders the next num_frames frames, read from src.
+  void add_frames(const uint8_t* src, const size_t num_frames) {
+    const size_t first = layout_.num_frames;
+    if (first + num_frames > max_frames_) {
+      throw cet::exception("FelixStreamReorderer")
+          << "Cannot add " << num_frames << " frames to " << first
+          << " frames, the fragment holds at most " << max_frames_;
+    }
+    uint8_t* dest = fragment_.dataBeginBytes();
+
+    FelixReorderer chunk(src, num_frames, &pool_);
+    chunk.wib_header_copy(dest + layout_.wib_headers_offset +
+                          first * FelixReorderer::wib_header_size);
+    chunk.crc32_copy(dest + layout_.crc32_offset +
+                     first * FelixReorderer::crc32_size);
+    chunk.coldata_header_copy(dest + layout_.coldata_headers_offset +
+                              first * FelixReorderer::num_blocks_per_frame *
+                                  FelixReorderer::coldata_header_size);
+
+    const FelixFrame* frames = reinterpret_cast<const FelixFrame*>(src);
+    adc_t* adcs = reinterpret_cast<adc_t*>(dest + layout_.adc_offset) + first;
+    const size_t stride = layout_.adc_row_stride;
+    const size_t num_tasks = std::max<size_t>(
+        1, std::min<size_t>(2 * pool_.size(),
+                            num_frames / FelixReorderer::min_frames_per_task));
+    const size_t frames_per_task =
+        ((num_frames + num_tasks - 1) / num_tasks + felix_stream_tile_frames -
+         1) / felix_stream_tile_frames * felix_stream_tile_frames;
+    pool_.parallel_for(num_tasks, [&](size_t i) {
+      const size_t fr_begin = i * frames_per_task;
+      const size_t fr_end = std::min(fr_begin + frames_per_task, num_frames);
+      if (fr_begin < fr_end) {
+        decode_frames(frames + fr_begin, fr_end - fr_begin, adcs + fr_begin,
+                      stride, true);
+      }
+    });
+
+    layout_.num_frames = first + num_frames;
+  }
+
+  // Number of frames added so far.
+  size_t num_frames() const { return layout_.num_frames; }
+  size_t max_frames() const { return max_frames_; }
+
+  // Writes the layout header and hands over the fragment. The reorderer must
+  // not be used afterwards.
+  artdaq::Fragment finish() {
+    memcpy(fragment_.dataBeginBytes(), &layout_, sizeof(layout_));
+    return std::move(fragment_);
+  }
+
+ private:
+  ReorderedFelixFrames::Header layout_;
+  const size_t max_frames_;
+  FelixThreadPool& pool_;
+  artdaq::Fragment fragment_;
+};
+
+inline void FelixReorderer::wib_header_copy(uint8_t* dest) {
   // Store WIB-headers next to each other.
   const uint8_t* src = head + netio_header_size;
   for (unsigned i = 0; i < num_frames; ++i) {
@@ -91,7 +302,7 @@ void FelixReorderer::wib_header_copy(uint8_t* dest) {
   }
 }
 
-void FelixReorderer::crc32_copy(uint8_t* dest) {
+inline void FelixReorderer::crc32_copy(uint8_t* dest) {
   // Store CRC32s next to each other.
   const uint8_t* src =
       head + netio_header_size + wib_header_size + 4 * coldata_block_size;
@@ -102,7 +313,7 @@ void FelixReorderer::crc32_copy(uint8_t* dest) {
   }
 }
 
-void FelixReorderer::coldata_header_copy(uint8_t* dest) {
+inline void FelixReorderer::coldata_header_copy(uint8_t* dest) {
   // Store COLDATA headers next to each other.
   const uint8_t* src = head + netio_header_size + wib_header_size;
   for (unsigned i = 0; i < num_frames; ++i) {
@@ -115,7 +326,7 @@ void FelixReorderer::coldata_header_copy(uint8_t* dest) {
   }
 }
 
-void FelixReorderer::initial_adc_copy(uint8_t* dest) {
+inline void FelixReorderer::initial_adc_copy(uint8_t* dest) {
   // Store all initial ADC values in uint16_t.
   const dune::FelixFrame* src =
       reinterpret_cast<dune::FelixFrame const*>(head +
@@ -128,8 +339,8 @@ void FelixReorderer::initial_adc_copy(uint8_t* dest) {
 }
 
 // ADC copy function to be executed by individual threads.
-void t_adc_copy_by_tick(FelixReorderer* reord, uint8_t* dest,
-                        const unsigned& t_inst, const unsigned& t_tot) {
+inline void t_adc_copy_by_tick(FelixReorderer* reord, uint8_t* dest,
+                               const unsigned& t_inst, const unsigned& t_tot) {
   // Thread starting point and range in ADC channel space.
   unsigned t_ch_range = reord->num_adcs_per_frame / t_tot;
   unsigned t_ch_begin = t_ch_range * t_inst;
@@ -152,44 +363,102 @@ void t_adc_copy_by_tick(FelixReorderer* reord, uint8_t* dest,
   }
 }
 
-// ADC copy function to be executed by individual threads.
-void t_adc_copy_by_channel(FelixReorderer* reord, uint8_t* dest,
-                           const unsigned& t_inst, const unsigned& t_tot) {
-  // Thread starting point and range in ADC channel space.
-  unsigned t_ch_range = reord->num_adcs_per_frame / t_tot;
-  unsigned t_ch_begin = t_ch_range * t_inst;
-  // The last thread should clean up the remainder of the channels.
-  if (t_inst == t_tot - 1 && reord->num_adcs_per_frame % t_tot != 0) {
-    t_ch_range = reord->num_adcs_per_frame - t_ch_begin;
-  }
-
+// ADC copy task: copies all channels of the frames in [fr_begin, fr_end).
+inline void t_adc_copy_by_channel(FelixReorderer* reord, uint8_t* dest,
+                                  const size_t& fr_begin, const size_t& fr_end) {
   // Store all ADC values in uint16_t.
   const dune::FelixFrame* src =
       reinterpret_cast<dune::FelixFrame const*>(
           reord->head + reord->netio_header_size);
-  for (unsigned fr = 0; fr < reord->num_frames; ++fr) {
-    for (unsigned ch = t_ch_begin; ch < t_ch_begin + t_ch_range; ++ch) {
+  for (size_t fr = fr_begin; fr < fr_end; ++fr) {
+    for (unsigned ch = 0; ch < reord->num_adcs_per_frame; ++ch) {
       adc_t curr_val = (src + fr)->channel(ch);
-      memcpy(dest + (ch * reord->num_frames + fr) * reord->adc_size, &curr_val,
-             reord->adc_size);
+      memcpy(dest + (ch * reord->layout.adc_row_stride + fr) * reord->adc_size,
+             &curr_val, reord->adc_size);
+    }
+  }
+}
+
+// ADC copy task using the tiled transpose: frames are unpacked in tiles that
+// stay in L1, transposed in registers and streamed out one channel row
+// segment at a time. Produces the same output as t_adc_copy_by_channel.
+inline void t_adc_copy_tiled(FelixReorderer* reord, uint8_t* dest,
+                             const size_t& fr_begin, const size_t& fr_end) {
+  const dune::FelixFrame* src =
+      reinterpret_cast<dune::FelixFrame const*>(
+          reord->head + reord->netio_header_size);
+  decode_frames(src + fr_begin, fr_end - fr_begin,
+                reinterpret_cast<adc_t*>(dest) + fr_begin,
+                reord->layout.adc_row_stride, true);
+}
+
+// ADC copy task for adc_packed12 data: frames are decoded one streaming tile
+// at a time into a small buffer of rows, whose segments are then packed
+// straight into their channel rows. Tasks start on tile boundaries, so they
+// never share a packed byte.
+inline void t_adc_copy_packed(FelixReorderer* reord, uint8_t* dest,
+                              const size_t& fr_begin, const size_t& fr_end) {
+  const dune::FelixFrame* src =
+      reinterpret_cast<dune::FelixFrame const*>(
+          reord->head + reord->netio_header_size);
+  const size_t nfr = felix_stream_tile_frames;
+  const size_t row_bytes =
+      ReorderedFelixFrames::packed_row_bytes(reord->layout.adc_row_stride);
+  adc_v rows(reord->num_adcs_per_frame * nfr);
+  for (size_t fr0 = fr_begin; fr0 < fr_end; fr0 += nfr) {
+    const size_t n = std::min(nfr, fr_end - fr0);
+    decode_frames(src + fr0, n, rows.data(), nfr);
+    for (unsigned ch = 0; ch < reord->num_adcs_per_frame; ++ch) {
+      FelixPacked12::pack(rows.data() + ch * nfr, n,
+                          dest + ch * row_bytes + fr0 / 2 * 3);
     }
   }
 }
 
-void FelixReorderer::adc_copy(uint8_t* dest) {
-  const unsigned t_tot = NUMBER_THREADS;
-  std::thread* t_vec = new std::thread[t_tot - 1];
+inline void FelixReorderer::adc_copy(uint8_t* dest) {
+  FelixThreadPool& p = pool ? *pool : FelixReorderEngine::shared().pool();
 
-  for (unsigned i = 0; i < t_tot - 1; ++i) {
-    t_vec[i] = std::thread(t_adc_copy_by_channel, this, dest, i, t_tot);
+  // Split the frames into a few tasks per thread, but never into tasks so
+  // small that scheduling them costs more than the copy.
+  size_t num_tasks = 2 * p.size();
+  if (num_tasks * min_frames_per_task > num_frames) {
+    num_tasks = num_frames / min_frames_per_task;
   }
-  t_adc_copy_by_channel(this, dest, t_tot - 1, t_tot);
-  for (unsigned i = 0; i < t_tot - 1; ++i) {
-    t_vec[i].join();
+  if (num_tasks < 1) num_tasks = 1;
+  const size_t frames_per_task =
+      ((num_frames + num_tasks - 1) / num_tasks + felix_stream_tile_frames -
+       1) / felix_stream_tile_frames * felix_stream_tile_frames;
+
+  p.parallel_for(num_tasks, [this, dest, frames_per_task](size_t i) {
+    const size_t fr_begin = i * frames_per_task;
+    const size_t fr_end = std::min(fr_begin + frames_per_task, num_frames);
+    if (fr_begin >= fr_end) return;
+    if (encoding == ReorderedFelixFrames::adc_packed12) {
+      t_adc_copy_packed(this, dest, fr_begin, fr_end);
+    } else {
+      t_adc_copy_tiled(this, dest, fr_begin, fr_end);
+    }
+  });
+
+  // Clear the padding at the end of each channel row.
+  if (encoding == ReorderedFelixFrames::adc_packed12) {
+    const size_t row_bytes =
+        ReorderedFelixFrames::packed_row_bytes(layout.adc_row_stride);
+    const size_t used = FelixPacked12::bytes(num_frames);
+    for (unsigned ch = 0; used < row_bytes && ch < num_adcs_per_frame; ++ch) {
+      memset(dest + ch * row_bytes + used, 0, row_bytes - used);
+    }
+    return;
+  }
+  const size_t pad = layout.adc_row_stride - num_frames;
+  for (unsigned ch = 0; pad && ch < num_adcs_per_frame; ++ch) {
+    memset(dest + (ch * layout.adc_row_stride + num_frames) * adc_size, 0,
+           pad * adc_size);
   }
 }
 
-void FelixReorderer::reorder_copy(uint8_t* dest) {
+inline void FelixReorderer::reorder_copy(uint8_t* dest) {
+  memcpy(dest, &layout, sizeof(layout));
   auto wib_start = std::chrono::high_resolution_clock::now();
   wib_header_copy(dest + wib_headers_begin);
   auto colhead_start = std::chrono::high_resolution_clock::now();
@@ -227,93 +496,19 @@ void FelixReorderer::reorder_copy(uint8_t* dest) {
       << "usec\n\n";
 }
 
-// The following section of code generates frames from a reordered buffer, but
-// requires FrameGen to work.
-// void FelixReorderer::single_frame_from_buffer(const uint8_t* src, uint8_t*
-// dest,
-//                                               const size_t& i) {
-//   framegen::Frame frame;
-//   // Install WIB header.
-//   const dune::FelixFragment::WIBHeader* head =
-//       reinterpret_cast<dune::FelixFragment::WIBHeader const*>(
-//           src + wib_headers_begin + wib_header_size * i);
-//   frame.set_sof(head->sof);
-//   frame.set_version(head->version);
-//   frame.set_fiber_no(head->fiber_no);
-//   frame.set_crate_no(head->crate_no);
-//   frame.set_slot_no(head->slot_no);
-//   frame.set_mm(head->mm);
-//   frame.set_oos(head->oos);
-//   frame.set_wib_errors(head->wib_errors);
-//   frame.set_z(head->z);
-//   frame.set_timestamp(head->timestamp());
-//   frame.set_wib_counter(head->wib_counter);
-
-//   // Install CRC32.
-//   const uint32_t* cbegin =
-//       reinterpret_cast<uint32_t const*>(src + crc32_begin + crc32_size * i);
-//   frame.set_CRC32(*(cbegin));
-
-//   // Install COLDATA headers.
-//   frame.clearReserved();
-
-//   const dune::FelixFragment::ColdataHeader* bhead =
-//       reinterpret_cast<dune::FelixFragment::ColdataHeader const*>(
-//           src + coldata_headers_begin +
-//           coldata_header_size * i * num_blocks_per_frame);
-//   for (unsigned j = 0; j < num_blocks_per_frame; ++j) {
-//     frame.set_s1_error(j, bhead->s1_error);
-//     frame.set_s2_error(j, bhead->s2_error);
-//     frame.set_checksum_a(j, bhead->checksum_a());
-//     frame.set_checksum_b(j, bhead->checksum_b());
-//     frame.set_coldata_convert_count(j, bhead->coldata_convert_count);
-//     frame.set_error_register(j, bhead->error_register);
-//     for (unsigned k = 0; k < 8; ++k) {
-//       frame.set_HDR(j, k, bhead->HDR(k));
-//     }
-
-//     ++bhead;
-//   }
-
-//   // Install COLDATA.
-//   if (i == 0) {
-//     for (unsigned j = 0; j < num_adcs_per_frame; ++j) {
-//       const uint16_t* abegin =
-//           reinterpret_cast<uint16_t const*>(src + initial_adc_begin);
-//       frame.set_channel(j, *(abegin + j));
-//       initial_adcs[j] = *(abegin + j);
-//     }
-//   } else {
-//     for (unsigned j = 0; j < num_adcs_per_frame; ++j) {
-//       const uint16_t* abegin = reinterpret_cast<uint16_t const*>(
-//           src + adc_begin + num_adcs_per_frame * adc_size * (i - 1));
-//       frame.set_channel(j, *(abegin + j) + initial_adcs[j]);
-//     }
-//   }
-
-//   // Clean up just in case.
-//   frame.clearReserved();
-
-//   // Copy to destination buffer.
-//   memcpy(dest + i * frame_size, reinterpret_cast<char*>(&frame), frame_size);
-// }
-
-// void FelixReorderer::frames_from_buffer(const uint8_t* src, uint8_t* dest,
-//                                         const size_t& num_frames) {
-//   for (size_t i = 0; i < num_frames; ++i) {
-//     single_frame_from_buffer(src, dest, i);
-//   }
-// }
-
-artdaq::Fragment FelixReorder(const uint8_t* src, const size_t& num_frames = 10000) {
-  FelixReorderer reorderer(src, num_frames);
-  artdaq::Fragment result;
-  result.resizeBytes(reorderer.newSize);
-  reorderer.reorder_copy(result.dataBeginBytes());
-
-  return result;
+inline artdaq::Fragment FelixReorder(
+    const uint8_t* src, const size_t& num_frames = 10000,
+    const ReorderedFelixFrames::AdcEncoding encoding =
+        ReorderedFelixFrames::adc_raw16) {
+  return FelixReorderEngine::shared().reorder(src, num_frames, encoding);
+}
+
+// Rebuilds the raw frames of a fragment made by FelixReorder(),
+// FelixEncode() or FelixCompress().
+inline artdaq::Fragment FelixRestore(const artdaq::Fragment& reordered) {
+  return FelixReorderEngine::shared().restore(reordered);
 }
 
 }  // namespace dune
 
-#endif /* artdaq_dune_Overlays_FelixReorder_hh */
\ No newline at end of file
+#endif /* artdaq_dune_Overlays_FelixReorder_hh */
@@ -0,0 +1,142 @@
+// FelixResync.hh
+// Frame boundary recovery for corrupted streams of FELIX frames.
+
+#ifndef artdaq_dune_Overlays_FelixResync_hh
+#define artdaq_dune_Overlays_FelixResync_hh
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "cetlib/exception.h"
+#include "dune-raw-data/Overlays/FelixFormat.hh"
+#include "dune-raw-data/Overlays/FelixFragment.hh"
+
+namespace dune {
+
+// A byte range of a stream that holds no usable frame.
+struct FelixResyncGap {
+  size_t begin;       // Offset at which frame alignment broke.
+  size_t end;         // Offset of the next valid frame, or the stream size.
+  size_t next_frame;  // Index in the frame table of the frame at end.
+};
+
+// Frame table of a stream: the byte offset of every valid frame, and the
+// ranges that were skipped to find them.
+struct FelixFrameTable {
+  std::vector<size_t> offsets;
+  std::vector<FelixResyncGap> gaps;
+
+  bool aligned() const { return gaps.empty(); }
+};
+
+// Finds the frames of a stream that may contain truncated frames or stray
+// bytes. A frame is recognised by the first three bytes of its WIB header:
+// the sof marker, the version and the link address (fiber, crate and slot),
+// which are the same for every frame of a link.
+//
+// Frames are checked at the fixed stride as long as they line up. Where a
+// frame does not match, the stream is searched for the next sof byte with
+// memchr and a candidate is accepted if the frame after it matches too. If
+// the new frame starts inside the previous one, the previous frame was
+// truncated and is dropped as well, so a damaged frame costs one frame
+// rather than the rest of the stream.
+class FelixFrameScanner {
+ public:
+  static constexpr size_t frame_size = sizeof(FelixFrame);
+
+  // Matches the sof marker and the version only.
+  FelixFrameScanner(const uint8_t sof, const uint8_t version)
+      : signature_(sof | uint32_t(version) << 8), mask_(0x1fff) {}
+  // Matches the sof marker, version and link address of a known good frame,
+  // e.g. the first frame of the previous fragment of the link.
+  explicit FelixFrameScanner(const FelixFrame& reference)
+      : signature_(0), mask_(0xffffff) {
+    memcpy(&signature_, &reference, 3);
+  }
+
+  bool matches(const uint8_t* header) const {
+    uint32_t v = 0;
+    memcpy(&v, header, 3);
+    return (v & mask_) == signature_;
+  }
+
+  // Frame table of size bytes of frames at data.
+  FelixFrameTable scan(const uint8_t* data, const size_t size) const {
+    FelixFrameTable table;
+    table.offsets.reserve(size / frame_size);
+    size_t p = 0;
+    while (p + frame_size <= size) {
+      if (matches(data + p)) {
+        table.offsets.push_back(p);
+        p += frame_size;
+        continue;
+      }
+      // Look for the next frame from just past the start of the previous
+      // one, in case that one was truncated.
+      const bool after_frame = !table.offsets.empty() &&
+                               table.offsets.back() + frame_size == p;
+      const size_t next =
+          find_(data, size, after_frame ? table.offsets.back() + 1 : p);
+      size_t begin = p;
+      if (next < p) {
+        begin = table.offsets.back();
+        table.offsets.pop_back();
+      }
+      add_gap_(table, begin, next);
+      p = next;
+    }
+    // A partial frame at the end.
+    if (p < size) add_gap_(table, p, size);
+    return table;
+  }
+
+  // Same for the frames of an unordered fragment. Reordered fragments hold
+  // no frames and throw cet::exception.
+  FelixFrameTable scan(const FelixFragment& fragment) const {
+    if (fragment.reordered()) {
+      throw cet::exception("FelixFrameScanner")
+          << "Cannot scan a reordered fragment for frames.";
+    }
+    return scan(static_cast<const uint8_t*>(fragment.data()),
+                fragment.size_bytes());
+  }
+
+ private:
+  // Offset of the first frame at or after from that matches and is followed
+  // by a matching frame or by the end of the stream, or size if there is
+  // none.
+  size_t find_(const uint8_t* data, const size_t size,
+               const size_t from) const {
+    const uint8_t sof = signature_ & 0xff;
+    for (size_t c = from; c + frame_size <= size; ++c) {
+      const void* hit = memchr(data + c, sof, size - frame_size + 1 - c);
+      if (!hit) break;
+      c = static_cast<const uint8_t*>(hit) - data;
+      if (!matches(data + c)) continue;
+      if (c + frame_size + 3 > size || matches(data + c + frame_size)) {
+        return c;
+      }
+    }
+    return size;
+  }
+
+  // Records [begin, end) as skipped, merging it with a gap that ends at
+  // begin.
+  static void add_gap_(FelixFrameTable& table, const size_t begin,
+                       const size_t end) {
+    if (!table.gaps.empty() && table.gaps.back().end == begin) {
+      table.gaps.back().end = end;
+    } else {
+      table.gaps.push_back(FelixResyncGap{begin, end, 0});
+    }
+    table.gaps.back().next_frame = table.offsets.size();
+  }
+
+  uint32_t signature_;
+  uint32_t mask_;
+};
+
+}  // namespace dune
+
+#endif /* artdaq_dune_Overlays_FelixResync_hh */
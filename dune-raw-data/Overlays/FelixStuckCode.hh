@@ -0,0 +1,271 @@
+// FelixStuckCode.hh
+// Detection and mitigation of stuck ADC codes and bits in FELIX data.
+
+#ifndef artdaq_dune_Overlays_FelixStuckCode_hh
+#define artdaq_dune_Overlays_FelixStuckCode_hh
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "dune-raw-data/Overlays/FelixDecode.hh"
+#include "dune-raw-data/Overlays/FelixFormat.hh"
+#include "dune-raw-data/Overlays/FelixFragment.hh"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace dune {
+
+// Decodes FELIX data like decode_frames() and checks the decoded waveforms
+// for the known failure modes of the FE ASIC ADCs in the same pass, while
+// each tile of decoded frames, or each channel row of a reordered fragment,
+// is still in cache:
+//  - stuck codes, samples whose low six bits are all 0 or all 1; the number
+//    of such samples is counted per channel;
+//  - stuck bits, bits that have the same value in every sample of a
+//    channel.
+// With mitigation enabled, stuck-code samples are replaced by a linear
+// interpolation between the closest good samples of the channel. Runs of
+// stuck samples at the end of the decoded range hold the last good value.
+//
+// Counts accumulate over calls until reset().
+class FelixStuckCodeDetector {
+ public:
+  static constexpr unsigned num_channels = FelixFrame::num_ch_per_frame;
+  static constexpr adc_t stuck_mask = 0x3f;
+  static constexpr adc_t adc_mask = 0xfff;
+
+  explicit FelixStuckCodeDetector(const bool mitigate = false)
+      : mitigate_(mitigate) {
+    reset();
+  }
+
+  void reset() {
+    samples_ = 0;
+    std::fill(stuck_, stuck_ + num_channels, 0);
+    std::fill(all_ones_, all_ones_ + num_channels, adc_t(adc_mask));
+    std::fill(any_ones_, any_ones_ + num_channels, 0);
+  }
+
+  bool mitigate() const { return mitigate_; }
+
+  // Decodes num_frames frames into dst like decode_frames().
+  void decode(const FelixFrame* frames, const size_t num_frames, adc_t* dst,
+              const size_t stride) {
+    begin_();
+    for (size_t fr0 = 0; fr0 < num_frames; fr0 += felix_decode_tile_frames) {
+      const size_t n = std::min(felix_decode_tile_frames, num_frames - fr0);
+      decode_frames(frames + fr0, n, dst + fr0, stride);
+      scan_(dst, stride, fr0, n);
+    }
+    end_(dst, stride, num_frames);
+  }
+
+  // Same for all frames of a fragment, in either layout.
+  void decode(const FelixFragment& fragment, adc_t* dst, const size_t stride) {
+    const size_t num_frames = fragment.total_frames();
+    if (fragment.contiguous()) {
+      decode(static_cast<const FelixFrame*>(fragment.data()), num_frames, dst,
+             stride);
+      return;
+    }
+    begin_();
+    if (fragment.reordered()) {
+      // Channel-major already: each row is checked right after it is
+      // decoded.
+      for (unsigned ch = 0; ch < num_channels; ++ch) {
+        adc_t* row = dst + ch * stride;
+        fragment.decode_channel(ch, row);
+        scan_row_(ch, row, 0, num_frames);
+      }
+      samples_ += num_frames;
+    } else {
+      // Frames at the offsets of a frame table, one tile at a time.
+      for (size_t fr0 = 0; fr0 < num_frames; fr0 += felix_decode_tile_frames) {
+        const size_t n = std::min(felix_decode_tile_frames, num_frames - fr0);
+        fragment.frame_range(fr0, n).decode_all(dst + fr0, stride);
+        scan_(dst, stride, fr0, n);
+      }
+    }
+    end_(dst, stride, num_frames);
+  }
+
+  // Number of samples per channel seen since reset().
+  uint64_t samples() const { return samples_; }
+  // Number of stuck-code samples of the channel.
+  uint64_t stuck_count(const unsigned ch) const { return stuck_[ch]; }
+  double stuck_fraction(const unsigned ch) const {
+    return samples_ ? double(stuck_[ch]) / samples_ : 0.;
+  }
+  // Bits of the channel that were set in every sample.
+  adc_t stuck_high_bits(const unsigned ch) const {
+    return samples_ ? all_ones_[ch] : 0;
+  }
+  // Bits of the channel that were clear in every sample.
+  adc_t stuck_low_bits(const unsigned ch) const {
+    return samples_ ? ~any_ones_[ch] & adc_mask : 0;
+  }
+  adc_t stuck_bits(const unsigned ch) const {
+    return stuck_high_bits(ch) | stuck_low_bits(ch);
+  }
+
+  // Channels whose stuck-code fraction exceeds max_fraction or that have a
+  // stuck bit among bits. The high bits of a quiet channel are naturally
+  // constant, so by default only the low six bits count.
+  std::vector<unsigned> flagged_channels(const double max_fraction,
+                                         const adc_t bits = stuck_mask) const {
+    std::vector<unsigned> flagged;
+    for (unsigned ch = 0; ch < num_channels; ++ch) {
+      if (stuck_fraction(ch) > max_fraction || (stuck_bits(ch) & bits)) {
+        flagged.push_back(ch);
+      }
+    }
+    return flagged;
+  }
+
+  static bool is_stuck(const adc_t adc) {
+    return (adc & stuck_mask) == 0 || (adc & stuck_mask) == stuck_mask;
+  }
+
+ private:
+  void begin_() {
+    std::fill(last_good_, last_good_ + num_channels, size_t(no_sample_));
+    std::fill(run_start_, run_start_ + num_channels, size_t(no_sample_));
+  }
+
+  // Checks ticks [fr0, fr0 + n) of every channel row of dst.
+  void scan_(adc_t* dst, const size_t stride, const size_t fr0,
+             const size_t n) {
+    for (unsigned ch = 0; ch < num_channels; ++ch) {
+      scan_row_(ch, dst + ch * stride, fr0, n);
+    }
+    samples_ += n;
+  }
+
+  // Checks ticks [fr0, fr0 + n) of the row of channel ch. The caller counts
+  // the samples.
+  void scan_row_(const unsigned ch, adc_t* row, const size_t fr0,
+                 const size_t n) {
+    size_t t = fr0;
+    const size_t end = fr0 + n;
+    unsigned stuck = 0;
+    adc_t all_ones = all_ones_[ch];
+    adc_t any_ones = any_ones_[ch];
+#if defined(__AVX2__)
+    const __m256i mask = _mm256_set1_epi16(stuck_mask);
+    __m256i and_acc = _mm256_set1_epi16(all_ones);
+    __m256i or_acc = _mm256_setzero_si256();
+    for (; t + 16 <= end; t += 16) {
+      const __m256i a =
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row + t));
+      const __m256i low = _mm256_and_si256(a, mask);
+      const __m256i hit =
+          _mm256_or_si256(_mm256_cmpeq_epi16(low, _mm256_setzero_si256()),
+                          _mm256_cmpeq_epi16(low, mask));
+      // Two mask bits per 16-bit lane.
+      stuck += __builtin_popcount(_mm256_movemask_epi8(hit)) / 2;
+      and_acc = _mm256_and_si256(and_acc, a);
+      or_acc = _mm256_or_si256(or_acc, a);
+    }
+    alignas(32) adc_t lanes[32];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), and_acc);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(lanes + 16), or_acc);
+    for (unsigned j = 0; j < 16; ++j) {
+      all_ones &= lanes[j];
+      any_ones |= lanes[16 + j];
+    }
+#elif defined(__SSE2__)
+    const __m128i mask = _mm_set1_epi16(stuck_mask);
+    __m128i and_acc = _mm_set1_epi16(all_ones);
+    __m128i or_acc = _mm_setzero_si128();
+    for (; t + 8 <= end; t += 8) {
+      const __m128i a =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + t));
+      const __m128i low = _mm_and_si128(a, mask);
+      const __m128i hit =
+          _mm_or_si128(_mm_cmpeq_epi16(low, _mm_setzero_si128()),
+                       _mm_cmpeq_epi16(low, mask));
+      stuck += __builtin_popcount(_mm_movemask_epi8(hit)) / 2;
+      and_acc = _mm_and_si128(and_acc, a);
+      or_acc = _mm_or_si128(or_acc, a);
+    }
+    alignas(16) adc_t lanes[16];
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes), and_acc);
+    _mm_store_si128(reinterpret_cast<__m128i*>(lanes + 8), or_acc);
+    for (unsigned j = 0; j < 8; ++j) {
+      all_ones &= lanes[j];
+      any_ones |= lanes[8 + j];
+    }
+#endif
+    for (; t < end; ++t) {
+      stuck += is_stuck(row[t]);
+      all_ones &= row[t];
+      any_ones |= row[t];
+    }
+    stuck_[ch] += stuck;
+    all_ones_[ch] = all_ones;
+    any_ones_[ch] = any_ones;
+    if (!mitigate_) return;
+    if (!stuck && run_start_[ch] == no_sample_) {
+      last_good_[ch] = end - 1;
+      return;
+    }
+    for (t = fr0; t < end; ++t) {
+      if (is_stuck(row[t])) {
+        if (run_start_[ch] == no_sample_) run_start_[ch] = t;
+        continue;
+      }
+      if (run_start_[ch] != no_sample_) {
+        interpolate_(row, last_good_[ch], run_start_[ch], t);
+        run_start_[ch] = no_sample_;
+      }
+      last_good_[ch] = t;
+    }
+  }
+
+  // Closes the runs of stuck samples that reach the end of the data.
+  void end_(adc_t* dst, const size_t stride, const size_t num_frames) {
+    if (!mitigate_) return;
+    for (unsigned ch = 0; ch < num_channels; ++ch) {
+      if (run_start_[ch] != no_sample_ && last_good_[ch] != no_sample_) {
+        adc_t* row = dst + ch * stride;
+        std::fill(row + run_start_[ch], row + num_frames, row[last_good_[ch]]);
+      }
+    }
+  }
+
+  // Replaces row[begin, end) by a straight line from row[before] to
+  // row[end], or by row[end] if there is no good sample before.
+  static void interpolate_(adc_t* row, const size_t before, const size_t begin,
+                           const size_t end) {
+    if (before == no_sample_) {
+      std::fill(row + begin, row + end, row[end]);
+      return;
+    }
+    const double a = row[before];
+    const double slope = (double(row[end]) - a) / (end - before);
+    for (size_t t = begin; t < end; ++t) {
+      row[t] = adc_t(a + slope * (t - before) + 0.5);
+    }
+  }
+
+  static constexpr size_t no_sample_ = size_t(-1);
+
+  const bool mitigate_;
+  uint64_t samples_;
+  uint64_t stuck_[num_channels];
+  adc_t all_ones_[num_channels];
+  adc_t any_ones_[num_channels];
+  // Interpolation state within one decode() call.
+  size_t last_good_[num_channels];
+  size_t run_start_[num_channels];
+};
+
+}  // namespace dune
+
+#endif /* artdaq_dune_Overlays_FelixStuckCode_hh */
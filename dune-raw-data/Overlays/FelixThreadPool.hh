@@ -0,0 +1,166 @@
+// FelixThreadPool.hh
+// Persistent worker pool for parallel processing of FELIX fragments.
+
+#ifndef artdaq_dune_Overlays_FelixThreadPool_hh
+#define artdaq_dune_Overlays_FelixThreadPool_hh
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace dune {
+
+// A fixed set of worker threads that is created once and reused for every
+// fragment. Work is submitted as a number of independent tasks; the calling
+// thread takes part in running them, so a job with a single task never
+// touches the workers at all. Several threads may submit jobs to the same
+// pool concurrently (e.g. one per FELIX link); jobs are served in order.
+class FelixThreadPool {
+ public:
+  // Creates a pool that runs jobs on num_threads threads in total, i.e. the
+  // submitting thread plus num_threads-1 workers. If cpus is not empty,
+  // worker i is pinned to core cpus[i % cpus.size()].
+  explicit FelixThreadPool(const unsigned num_threads,
+                           const std::vector<int>& cpus = std::vector<int>()) {
+    for (unsigned i = 1; i < num_threads; ++i) {
+      workers_.emplace_back(&FelixThreadPool::worker_loop_, this);
+#ifdef __linux__
+      if (!cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpus[(i - 1) % cpus.size()], &set);
+        pthread_setaffinity_np(workers_.back().native_handle(), sizeof(set),
+                               &set);
+      }
+#endif
+    }
+  }
+
+  ~FelixThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    work_cv_.notify_all();
+    for (auto& t : workers_) {
+      t.join();
+    }
+  }
+
+  FelixThreadPool(const FelixThreadPool&) = delete;
+  FelixThreadPool& operator=(const FelixThreadPool&) = delete;
+
+  // Number of threads that run a job, including the submitting thread.
+  unsigned size() const { return workers_.size() + 1; }
+
+  // Runs task(i) for every i in [0, num_tasks) and returns once all of them
+  // have finished. If a task throws, the tasks that have not started yet are
+  // skipped and the first exception is rethrown here once the running ones
+  // are done.
+  void parallel_for(const size_t num_tasks,
+                    const std::function<void(size_t)>& task) {
+    if (num_tasks == 0) return;
+    if (num_tasks == 1 || workers_.empty()) {
+      for (size_t i = 0; i < num_tasks; ++i) task(i);
+      return;
+    }
+
+    Job job(task, num_tasks);
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      jobs_.push_back(&job);
+    }
+    work_cv_.notify_all();
+
+    run_(job);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    retire_(&job);
+    done_cv_.wait(lock, [&job] {
+      return job.done.load() == job.num_tasks && job.users == 0;
+    });
+    if (job.error) std::rethrow_exception(job.error);
+  }
+
+ private:
+  struct Job {
+    Job(const std::function<void(size_t)>& t, const size_t n)
+        : task(t), num_tasks(n), next(0), done(0), users(0) {}
+    const std::function<void(size_t)>& task;
+    const size_t num_tasks;
+    std::atomic<size_t> next;
+    std::atomic<size_t> done;
+    unsigned users;  // Workers holding a pointer to the job; guarded by mutex_.
+    std::exception_ptr error;  // First exception of a task; guarded by mutex_.
+  };
+
+  // Claims and runs tasks of the job until none are left. Exceptions never
+  // leave it: the first one is kept in the job and the unclaimed tasks are
+  // claimed and counted as done, so the job still completes.
+  void run_(Job& job) {
+    size_t i;
+    while ((i = job.next.fetch_add(1)) < job.num_tasks) {
+      size_t finished = 1;
+      try {
+        job.task(i);
+      } catch (...) {
+        const size_t next = job.next.exchange(job.num_tasks);
+        if (next < job.num_tasks) finished += job.num_tasks - next;
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!job.error) job.error = std::current_exception();
+      }
+      if (job.done.fetch_add(finished) + finished == job.num_tasks) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done_cv_.notify_all();
+      }
+    }
+  }
+
+  // Removes a job whose tasks have all been claimed from the queue. Must be
+  // called with mutex_ held.
+  void retire_(Job* job) {
+    for (auto it = jobs_.begin(); it != jobs_.end(); ++it) {
+      if (*it == job) {
+        jobs_.erase(it);
+        break;
+      }
+    }
+  }
+
+  void worker_loop_() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+      work_cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+      if (stop_) return;
+      Job* job = jobs_.front();
+      ++job->users;
+      lock.unlock();
+      run_(*job);
+      lock.lock();
+      retire_(job);
+      --job->users;
+      done_cv_.notify_all();
+    }
+  }
+
+  std::vector<std::thread> workers_;
+  std::deque<Job*> jobs_;
+  std::mutex mutex_;
+  std::condition_variable work_cv_;
+  std::condition_variable done_cv_;
+  bool stop_ = false;
+};
+
+}  // namespace dune
+
+#endif /* artdaq_dune_Overlays_FelixThreadPool_hh */
@@ -0,0 +1,290 @@
+// FelixTimestamps.hh
+// Bulk extraction and continuity checks of WIB timestamps.
+
+#ifndef artdaq_dune_Overlays_FelixTimestamps_hh
+#define artdaq_dune_Overlays_FelixTimestamps_hh
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#include "cetlib/exception.h"
+#include "dune-raw-data/Overlays/FelixFormat.hh"
+#include "dune-raw-data/Overlays/FelixFragment.hh"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+namespace dune {
+
+// Number of 50 MHz clock ticks between consecutive WIB frames.
+static constexpr uint64_t felix_ticks_per_frame = 25;
+
+// Reads the timestamps of num_headers WIB headers that lie header_stride
+// bytes apart, starting at first_header, into out. Equivalent to
+// out[i] = WIBHeader::timestamp() for every header.
+//
+// The timestamp occupies the upper 64 bits of the header. If the z bit (the
+// top bit) is clear, bits 48-62 extend the timestamp; otherwise they hold
+// the WIB counter and only the lower 48 bits are the timestamp.
+inline void gather_timestamps(const uint8_t* first_header,
+                              const size_t header_stride,
+                              const size_t num_headers, uint64_t* out) {
+  const uint64_t mask_z = 0x0000FFFFFFFFFFFF;
+  const uint64_t mask_no_z = 0x7FFFFFFFFFFFFFFF;
+  const uint8_t* p = first_header + 8;
+  size_t i = 0;
+#if defined(__AVX2__)
+  const __m256i offsets =
+      _mm256_setr_epi64x(0, header_stride, 2 * header_stride,
+                         3 * header_stride);
+  const __m256i vmask_z = _mm256_set1_epi64x(mask_z);
+  const __m256i vmask_no_z = _mm256_set1_epi64x(mask_no_z);
+  for (; i + 4 <= num_headers; i += 4) {
+    const __m256i v = _mm256_i64gather_epi64(
+        reinterpret_cast<const long long*>(p + i * header_stride), offsets, 1);
+    // z is the sign bit of the 64-bit word.
+    const __m256i z = _mm256_cmpgt_epi64(_mm256_setzero_si256(), v);
+    const __m256i mask = _mm256_blendv_epi8(vmask_no_z, vmask_z, z);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i),
+                        _mm256_and_si256(v, mask));
+  }
+#endif
+  for (; i < num_headers; ++i) {
+    uint64_t v;
+    memcpy(&v, p + i * header_stride, sizeof(v));
+    out[i] = v & (v >> 63 ? mask_z : mask_no_z);
+  }
+}
+
+// Timestamps of all frames of a fragment, in either layout.
+inline std::vector<uint64_t> gather_timestamps(const FelixFragment& fragment) {
+  std::vector<uint64_t> timestamps(fragment.total_frames());
+  const uint8_t* data = static_cast<const uint8_t*>(fragment.data());
+  if (fragment.reordered()) {
+    const ReorderedFelixFrames* frames =
+        reinterpret_cast<const ReorderedFelixFrames*>(data);
+    if (frames->header().header_encoding ==
+        ReorderedFelixFrames::headers_compact) {
+      for (size_t i = 0; i < timestamps.size(); ++i) {
+        timestamps[i] = frames->timestamp(fragment.first_frame() + i);
+      }
+      return timestamps;
+    }
+    gather_timestamps(data + frames->header().wib_headers_offset +
+                          fragment.first_frame() * sizeof(WIBHeader),
+                      sizeof(WIBHeader), timestamps.size(), timestamps.data());
+  } else if (fragment.contiguous()) {
+    gather_timestamps(data, sizeof(FelixFrame), timestamps.size(),
+                      timestamps.data());
+  } else {
+    for (size_t i = 0; i < timestamps.size(); ++i) {
+      timestamps[i] = fragment.frame(i)->timestamp();
+    }
+  }
+  return timestamps;
+}
+
+//=============================
+// Timestamp continuity report
+//=============================
+// A run of consecutive frame steps that deviate from the expected stride in
+// the same way. Step i goes from frame i-1 to frame i.
+struct FelixTimestampIssue {
+  enum Kind : uint8_t {
+    gap,           // step larger than the stride: frames are missing
+    duplicate,     // step of zero
+    out_of_order,  // step backwards in time
+    misaligned,    // step between zero and the stride
+  };
+
+  Kind kind;
+  size_t first_frame;  // Frame at the end of the first deviating step.
+  size_t num_steps;    // Number of consecutive steps in the run.
+  int64_t step;        // Step of the first frame of the run, in ticks.
+};
+
+// Checks that consecutive timestamps advance by exactly stride ticks and
+// returns the deviations, consecutive ones of the same kind and step merged
+// into runs. Regular stretches are skipped four steps at a time with AVX2.
+inline std::vector<FelixTimestampIssue> scan_timestamps(
+    const uint64_t* timestamps, const size_t num_frames,
+    const uint64_t stride = felix_ticks_per_frame) {
+  std::vector<FelixTimestampIssue> issues;
+  size_t i = 1;
+  while (i < num_frames) {
+#if defined(__AVX2__)
+    const __m256i vstride = _mm256_set1_epi64x(stride);
+    while (i + 4 <= num_frames) {
+      const __m256i cur = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(timestamps + i));
+      const __m256i prev = _mm256_loadu_si256(
+          reinterpret_cast<const __m256i*>(timestamps + i - 1));
+      const __m256i ok =
+          _mm256_cmpeq_epi64(_mm256_sub_epi64(cur, prev), vstride);
+      if (_mm256_movemask_epi8(ok) != -1) break;
+      i += 4;
+    }
+    if (i >= num_frames) break;
+#endif
+    const int64_t step = timestamps[i] - timestamps[i - 1];
+    if (step == int64_t(stride)) {
+      ++i;
+      continue;
+    }
+    FelixTimestampIssue::Kind kind;
+    if (step == 0) {
+      kind = FelixTimestampIssue::duplicate;
+    } else if (step < 0) {
+      kind = FelixTimestampIssue::out_of_order;
+    } else if (step > int64_t(stride)) {
+      kind = FelixTimestampIssue::gap;
+    } else {
+      kind = FelixTimestampIssue::misaligned;
+    }
+    if (!issues.empty() && issues.back().kind == kind &&
+        issues.back().first_frame + issues.back().num_steps == i &&
+        issues.back().step == step) {
+      ++issues.back().num_steps;
+    } else {
+      issues.push_back(FelixTimestampIssue{kind, i, 1, step});
+    }
+    ++i;
+  }
+  return issues;
+}
+
+inline std::vector<FelixTimestampIssue> scan_timestamps(
+    const FelixFragment& fragment,
+    const uint64_t stride = felix_ticks_per_frame) {
+  const std::vector<uint64_t> timestamps = gather_timestamps(fragment);
+  return scan_timestamps(timestamps.data(), timestamps.size(), stride);
+}
+
+//========================
+// Sorting frames by time
+//========================
+// Whether the timestamps never decrease, checked four steps at a time with
+// AVX2. Timestamps are at most 63 bits wide, so the signed comparison is
+// exact.
+inline bool timestamps_sorted(const uint64_t* timestamps,
+                              const size_t num_frames) {
+  size_t i = 1;
+#if defined(__AVX2__)
+  for (; i + 4 <= num_frames; i += 4) {
+    const __m256i cur =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(timestamps + i));
+    const __m256i prev = _mm256_loadu_si256(
+        reinterpret_cast<const __m256i*>(timestamps + i - 1));
+    if (_mm256_movemask_epi8(_mm256_cmpgt_epi64(prev, cur))) return false;
+  }
+#endif
+  for (; i < num_frames; ++i) {
+    if (timestamps[i] < timestamps[i - 1]) return false;
+  }
+  return true;
+}
+
+// Order of frames by timestamp: order[k] is the index of the k-th earliest
+// frame, and frames with equal timestamps keep their relative order. Input
+// that is already in order is recognised in one pass. Otherwise this is a
+// stable LSD radix sort of (timestamp, index) pairs, eight bits per pass
+// over the bits in which the timestamps differ; the histograms of all
+// passes are taken in a single read of the keys.
+inline std::vector<size_t> timestamp_order(const uint64_t* timestamps,
+                                           const size_t num_frames) {
+  std::vector<size_t> order(num_frames);
+  std::iota(order.begin(), order.end(), size_t(0));
+  if (timestamps_sorted(timestamps, num_frames)) return order;
+
+  const auto range = std::minmax_element(timestamps, timestamps + num_frames);
+  const uint64_t base = *range.first;
+  const unsigned bits = 64 - __builtin_clzll(*range.second - base);
+  const unsigned num_passes = (bits + 7) / 8;
+  std::vector<uint64_t> keys(num_frames);
+  std::vector<size_t> count(num_passes * 256, 0);
+  for (size_t i = 0; i < num_frames; ++i) {
+    keys[i] = timestamps[i] - base;
+    for (unsigned p = 0; p < num_passes; ++p) {
+      ++count[p * 256 + (keys[i] >> 8 * p & 0xff)];
+    }
+  }
+
+  std::vector<uint64_t> keys_out(num_frames);
+  std::vector<size_t> order_out(num_frames);
+  for (unsigned p = 0; p < num_passes; ++p) {
+    size_t* c = count.data() + p * 256;
+    // A digit that is the same for every frame does not reorder anything.
+    if (*std::max_element(c, c + 256) == num_frames) continue;
+    size_t sum = 0;
+    for (unsigned d = 0; d < 256; ++d) {
+      const size_t n = c[d];
+      c[d] = sum;
+      sum += n;
+    }
+    for (size_t i = 0; i < num_frames; ++i) {
+      const size_t pos = c[keys[i] >> 8 * p & 0xff]++;
+      keys_out[pos] = keys[i];
+      order_out[pos] = order[i];
+    }
+    keys.swap(keys_out);
+    order.swap(order_out);
+  }
+  return order;
+}
+
+// Same for the frames of a fragment, in either layout.
+inline std::vector<size_t> timestamp_order(const FelixFragment& fragment) {
+  const std::vector<uint64_t> timestamps = gather_timestamps(fragment);
+  return timestamp_order(timestamps.data(), timestamps.size());
+}
+
+// Frame table that presents the frames of an unordered fragment in time
+// order without moving them; overlay it with
+// FelixFragment(fragment.data(), fragment.size_bytes(), offsets).
+// Reordered fragments have no frames to point at and throw cet::exception.
+inline std::vector<size_t> time_ordered_offsets(
+    const FelixFragment& fragment) {
+  if (fragment.reordered()) {
+    throw cet::exception("FelixTimestamps")
+        << "A reordered fragment has no frame offsets.";
+  }
+  std::vector<size_t> offsets = timestamp_order(fragment);
+  const uint8_t* data = static_cast<const uint8_t*>(fragment.data());
+  for (size_t& o : offsets) {
+    o = reinterpret_cast<const uint8_t*>(fragment.frame(o)) - data;
+  }
+  return offsets;
+}
+
+// Sorts an array of frames by timestamp in place. Frames move along the
+// cycles of the permutation, so each one is copied once.
+inline void sort_frames_by_timestamp(FelixFrame* frames,
+                                     const size_t num_frames) {
+  std::vector<uint64_t> timestamps(num_frames);
+  gather_timestamps(reinterpret_cast<const uint8_t*>(frames),
+                    sizeof(FelixFrame), num_frames, timestamps.data());
+  if (timestamps_sorted(timestamps.data(), num_frames)) return;
+  const std::vector<size_t> order =
+      timestamp_order(timestamps.data(), num_frames);
+  std::vector<bool> placed(num_frames, false);
+  for (size_t start = 0; start < num_frames; ++start) {
+    if (placed[start] || order[start] == start) continue;
+    const FelixFrame first = frames[start];
+    size_t k = start;
+    while (order[k] != start) {
+      frames[k] = frames[order[k]];
+      placed[k] = true;
+      k = order[k];
+    }
+    frames[k] = first;
+    placed[k] = true;
+  }
+}
+
+}  // namespace dune
+
+#endif /* artdaq_dune_Overlays_FelixTimestamps_hh */
@@ -1,14 +1,34 @@
 #include <stdint.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
 #include <bitset>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <map>
 #include <memory>
+#include <numeric>
 #include <vector>
 #include <string>
+#include <thread>
 #include "artdaq-core/Data/Fragment.hh"
+// The COLDATA checksum validators are opt-in until verified, see
+// FelixChecksum.hh.
+#define FELIX_UNVERIFIED_CHECKSUMS
+#include "dune-raw-data/Overlays/FelixApa.hh"
+#include "dune-raw-data/Overlays/FelixChecksum.hh"
+#include "dune-raw-data/Overlays/FelixCompress.hh"
+#include "dune-raw-data/Overlays/FelixFile.hh"
+#include "dune-raw-data/Overlays/FelixCrc.hh"
 #include "dune-raw-data/Overlays/FelixFragment.hh"
+#include "dune-raw-data/Overlays/FelixHitFinder.hh"
+#include "dune-raw-data/Overlays/FelixMonitor.hh"
 #include "dune-raw-data/Overlays/FelixReorder.hh"
+#include "dune-raw-data/Overlays/FelixResync.hh"
+#include "dune-raw-data/Overlays/FelixStuckCode.hh"
+#include "dune-raw-data/Overlays/FelixThreadPool.hh"
+#include "dune-raw-data/Overlays/FelixTimestamps.hh"
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wsign-compare"
@@ -129,6 +149,1501 @@ BOOST_AUTO_TEST_CASE(BaselineTest) {
   std::cout << "### WOOF WOOF -> Done...\n";
 }
 
+BOOST_AUTO_TEST_CASE(UnpackAllTest) {
+  std::cout << "### WOOF -> Testing bulk frame unpacking...\n";
+
+  // Fill a handful of frames with random bits and compare the bulk decoder
+  // against the per-channel bit field accessor.
+  const size_t frames = 100;
+  std::vector<dune::FelixFrame> buf(frames);
+  uint8_t* bytes = reinterpret_cast<uint8_t*>(buf.data());
+  std::srand(42);
+  for (size_t i = 0; i < frames * sizeof(dune::FelixFrame); ++i) {
+    bytes[i] = std::rand() & 0xff;
+  }
+
+  dune::adc_t out[256];
+  for (size_t fr = 0; fr < frames; ++fr) {
+    buf[fr].unpack_all(out);
+    for (unsigned ch = 0; ch < 256; ++ch) {
+      BOOST_REQUIRE_EQUAL(out[ch], buf[fr].channel(ch));
+    }
+  }
+
+  std::cout << "### WOOF WOOF -> Done...\n";
+}
+
+BOOST_AUTO_TEST_CASE(DecodeAllTest) {
+  std::cout << "### WOOF -> Testing bulk fragment decoding...\n";
+
+  // An odd number of frames exercises the partial tile at the end.
+  const size_t frames = 1003;
+  const size_t stride = frames + 5;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  std::srand(43);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+  dune::FelixFragment flxfrg(frag);
+
+  std::vector<dune::adc_t> out(256 * stride);
+  flxfrg.decode_all(out.data(), stride);
+  for (size_t fr = 0; fr < frames; ++fr) {
+    for (unsigned ch = 0; ch < 256; ++ch) {
+      BOOST_REQUIRE_EQUAL(out[ch * stride + fr], flxfrg.get_ADC(fr, ch));
+    }
+  }
+
+  // Streaming stores need cache-line aligned rows; destinations at any
+  // offset from a cache line start with plain stores and give the same
+  // result.
+  const size_t nt_stride = (frames + 31) / 32 * 32;
+  std::vector<dune::adc_t> nt_buf(256 * nt_stride + 64);
+  const dune::FelixFrame* frm =
+      reinterpret_cast<const dune::FelixFrame*>(frag.dataBeginBytes());
+  for (size_t offset : {0, 1, 7, 31, 32}) {
+    dune::adc_t* nt = reinterpret_cast<dune::adc_t*>(
+        (reinterpret_cast<uintptr_t>(nt_buf.data()) + 63) / 64 * 64) +
+        offset;
+    dune::decode_frames(frm, frames, nt, nt_stride, true);
+    for (unsigned ch = 0; ch < 256; ++ch) {
+      BOOST_REQUIRE(std::equal(nt + ch * nt_stride,
+                               nt + ch * nt_stride + frames,
+                               out.begin() + ch * stride));
+    }
+  }
+
+  std::cout << "### WOOF WOOF -> Done...\n";
+}
+
+BOOST_AUTO_TEST_CASE(RawBufferTest) {
+  std::cout << "### WOOF -> Testing overlays on caller-owned memory...\n";
+
+  const size_t frames = 64;
+  std::vector<dune::FelixFrame> buf(frames);
+  uint8_t* bytes = reinterpret_cast<uint8_t*>(buf.data());
+  std::srand(44);
+  for (size_t i = 0; i < frames * sizeof(dune::FelixFrame); ++i) {
+    bytes[i] = std::rand() & 0xff;
+  }
+
+  // The overlay must point straight into the caller's buffer.
+  dune::FelixFragment flxfrg(buf.data(), frames * sizeof(dune::FelixFrame));
+  BOOST_REQUIRE_EQUAL(flxfrg.total_frames(), frames);
+  for (size_t fr = 0; fr < frames; ++fr) {
+    BOOST_REQUIRE_EQUAL(flxfrg.timestamp(fr), buf[fr].timestamp());
+    BOOST_REQUIRE_EQUAL(flxfrg.get_ADC(fr, 17), buf[fr].channel(17));
+  }
+  buf[3].set_channel(17, 0xabc);
+  BOOST_REQUIRE_EQUAL(flxfrg.get_ADC(3, 17), 0xabc);
+
+  std::cout << "### WOOF WOOF -> Done...\n";
+}
+
+BOOST_AUTO_TEST_CASE(ReorderLengthTest) {
+  std::cout << "### MEOW -> Testing reordering of a short window...\n";
+
+  // Reordered fragments describe their own length, so any number of frames
+  // can be reordered.
+  const size_t frames = 250;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  std::srand(45);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+  dune::FelixFragment flxfrg(frag);
+
+  artdaq::Fragment reordfrg(dune::FelixReorder(frag.dataBeginBytes(), frames));
+  dune::FelixFragment reordflxfrg(reordfrg, 1);
+  BOOST_REQUIRE_EQUAL(reordflxfrg.total_frames(), frames);
+
+  for (unsigned i = 0; i < frames; ++i) {
+    BOOST_REQUIRE_EQUAL(flxfrg.sof(i), reordflxfrg.sof(i));
+    BOOST_REQUIRE_EQUAL(flxfrg.timestamp(i), reordflxfrg.timestamp(i));
+    BOOST_REQUIRE_EQUAL(flxfrg.CRC32(i), reordflxfrg.CRC32(i));
+    for (unsigned j = 0; j < 4; ++j) {
+      BOOST_REQUIRE_EQUAL(flxfrg.checksum_a(i, j),
+                          reordflxfrg.checksum_a(i, j));
+      BOOST_REQUIRE_EQUAL(flxfrg.coldata_convert_count(i, j),
+                          reordflxfrg.coldata_convert_count(i, j));
+      for (unsigned h = 1; h <= 8; ++h) {
+        BOOST_REQUIRE_EQUAL(flxfrg.hdr(i, j, h), reordflxfrg.hdr(i, j, h));
+      }
+    }
+    for (unsigned ch = 0; ch < 256; ++ch) {
+      BOOST_REQUIRE_EQUAL(flxfrg.get_ADC(i, ch), reordflxfrg.get_ADC(i, ch));
+    }
+  }
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(ReorderEngineTest) {
+  std::cout << "### MEOW -> Testing the shared reorder engine...\n";
+
+  const size_t frames = 3000;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  std::srand(46);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+
+  // Reference output from a single-threaded engine.
+  dune::FelixReorderEngine serial(1);
+  artdaq::Fragment reference(serial.reorder(frag.dataBeginBytes(), frames));
+
+  // Several links reordering concurrently on one shared pool.
+  dune::FelixReorderEngine engine(4);
+  std::vector<artdaq::Fragment> results(3);
+  std::vector<std::thread> links;
+  for (unsigned l = 0; l < results.size(); ++l) {
+    links.emplace_back([&, l] {
+      for (unsigned rep = 0; rep < 5; ++rep) {
+        results[l] = engine.reorder(frag.dataBeginBytes(), frames);
+      }
+    });
+  }
+  for (auto& t : links) t.join();
+
+  for (auto const& result : results) {
+    BOOST_REQUIRE_EQUAL(result.dataSizeBytes(), reference.dataSizeBytes());
+    BOOST_REQUIRE(memcmp(result.dataBeginBytes(), reference.dataBeginBytes(),
+                         reference.dataSizeBytes()) == 0);
+  }
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(ThreadPoolExceptionTest) {
+  std::cout << "### MEOW -> Testing exceptions thrown by pooled tasks...\n";
+
+  // A throwing task, whichever thread runs it, ends the job and its
+  // exception reaches the submitting thread. The pool stays usable.
+  dune::FelixThreadPool pool(4);
+  for (size_t bad : {0, 1, 499, 999}) {
+    std::atomic<size_t> ran(0);
+    BOOST_CHECK_THROW(pool.parallel_for(1000,
+                                        [&](size_t i) {
+                                          ++ran;
+                                          if (i == bad) {
+                                            throw cet::exception("Test")
+                                                << "task " << i;
+                                          }
+                                          usleep(10);
+                                        }),
+                      cet::exception);
+    BOOST_CHECK_LE(ran.load(), 1000u);
+  }
+  std::atomic<size_t> ran(0);
+  pool.parallel_for(100, [&](size_t) { ++ran; });
+  BOOST_CHECK_EQUAL(ran.load(), 100u);
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(ReorderBenchmarkTest) {
+  std::cout << "### MEOW -> Benchmarking the reorder ADC copy...\n";
+
+  const size_t frames = 10000;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  std::srand(47);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+  dune::FelixReorderer reorderer(frag.dataBeginBytes(), frames);
+
+  // Single-threaded comparison of the per-element and tiled copies. The
+  // tiled output is cache-line aligned so that it is streamed out.
+  const size_t values = reorderer.layout.adc_row_stride * 256;
+  std::vector<dune::adc_t> by_element(values);
+  std::vector<dune::adc_t> tiled_buf(values + 32);
+  dune::adc_t* tiled = reinterpret_cast<dune::adc_t*>(
+      (reinterpret_cast<uintptr_t>(tiled_buf.data()) + 63) / 64 * 64);
+  auto elem_begin = std::chrono::high_resolution_clock::now();
+  dune::t_adc_copy_by_channel(
+      &reorderer, reinterpret_cast<uint8_t*>(by_element.data()), 0, frames);
+  auto tiled_begin = std::chrono::high_resolution_clock::now();
+  dune::t_adc_copy_tiled(&reorderer, reinterpret_cast<uint8_t*>(tiled), 0,
+                         frames);
+  auto tiled_end = std::chrono::high_resolution_clock::now();
+
+  for (unsigned ch = 0; ch < 256; ++ch) {
+    const size_t row = ch * reorderer.layout.adc_row_stride;
+    BOOST_REQUIRE(std::equal(tiled + row, tiled + row + frames,
+                             by_element.begin() + row));
+  }
+  std::cout << "Per-element ADC copy: "
+            << std::chrono::duration_cast<std::chrono::microseconds>(
+                   tiled_begin - elem_begin).count()
+            << " usec\n"
+            << "Tiled ADC copy: "
+            << std::chrono::duration_cast<std::chrono::microseconds>(
+                   tiled_end - tiled_begin).count()
+            << " usec\n";
+}
+
+BOOST_AUTO_TEST_CASE(CompressTest) {
+  std::cout << "### MEOW -> Testing delta + Huffman compression...\n";
+
+  // Pedestals with small noise and a few large pulses, which are coded as
+  // escapes.
+  const size_t frames = 2000;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  std::srand(48);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+  dune::FelixFrame* frm =
+      reinterpret_cast<dune::FelixFrame*>(frag.dataBeginBytes());
+  for (size_t i = 0; i < frames; ++i) {
+    for (unsigned ch = 0; ch < 256; ++ch) {
+      int adc = 500 + 3 * ch + std::rand() % 7 - 3;
+      if (std::rand() % 1000 == 0) adc += 1500;
+      frm[i].set_channel(ch, adc);
+    }
+  }
+
+  artdaq::Fragment reordfrg(dune::FelixReorder(frag.dataBeginBytes(), frames));
+  artdaq::Fragment compfrg(dune::FelixCompress(reordfrg));
+  std::cout << "Reordered size: " << reordfrg.dataSizeBytes()
+            << " bytes, compressed size: " << compfrg.dataSizeBytes()
+            << " bytes\n";
+  BOOST_REQUIRE_LT(compfrg.dataSizeBytes(), reordfrg.dataSizeBytes() / 2);
+
+  // The raw ADC accessors of the format refuse the compressed section.
+  const dune::ReorderedFelixFrames* compframes =
+      reinterpret_cast<const dune::ReorderedFelixFrames*>(
+          compfrg.dataBeginBytes());
+  BOOST_CHECK_THROW(compframes->channel(0, 17), cet::exception);
+  BOOST_CHECK_THROW(compframes->channel_row(17), cet::exception);
+  BOOST_CHECK_THROW(compframes->waveform(17), cet::exception);
+
+  // So does the row decoder for encodings it does not know.
+  artdaq::Fragment unknownfrg(compfrg);
+  reinterpret_cast<dune::ReorderedFelixFrames::Header*>(
+      unknownfrg.dataBeginBytes())->adc_encoding = 7;
+  BOOST_CHECK_THROW(
+      dune::FelixRowDecoder(reinterpret_cast<dune::ReorderedFelixFrames*>(
+          unknownfrg.dataBeginBytes())),
+      cet::exception);
+
+  dune::FelixFragment flxfrg(frag);
+  dune::FelixFragment compflxfrg(compfrg, 1);
+  BOOST_REQUIRE_EQUAL(compflxfrg.total_frames(), frames);
+  for (unsigned i = 0; i < frames; i += 7) {
+    BOOST_REQUIRE_EQUAL(flxfrg.timestamp(i), compflxfrg.timestamp(i));
+    BOOST_REQUIRE_EQUAL(flxfrg.CRC32(i), compflxfrg.CRC32(i));
+    BOOST_REQUIRE_EQUAL(flxfrg.get_ADC(i, 17), compflxfrg.get_ADC(i, 17));
+  }
+
+  std::vector<dune::adc_t> expected(frames * 256);
+  std::vector<dune::adc_t> decoded(frames * 256);
+  flxfrg.decode_all(expected.data(), frames);
+  compflxfrg.decode_all(decoded.data(), frames);
+  BOOST_REQUIRE(expected == decoded);
+
+  // Threads sharing one overlay fill its row cache concurrently.
+  const dune::FelixFragment shared(compfrg, 1);
+  std::atomic<size_t> mismatches(0);
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t] {
+      for (unsigned k = 0; k < 256; ++k) {
+        const unsigned ch = (k + 64 * t) % 256;
+        for (unsigned i = 0; i < frames; i += 13) {
+          if (shared.get_ADC(i, ch) != expected[ch * frames + i]) ++mismatches;
+        }
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  BOOST_REQUIRE_EQUAL(mismatches.load(), 0u);
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(RestoreTest) {
+  std::cout << "### MEOW -> Testing restoring frames from reordered data...\n";
+
+  const size_t frames = 1001;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  std::srand(49);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+
+  // Every bit of a frame is either a header bit or an ADC bit, so restoring
+  // must give back the original fragment exactly.
+  artdaq::Fragment reordfrg(dune::FelixReorder(frag.dataBeginBytes(), frames));
+  artdaq::Fragment restored(dune::FelixRestore(reordfrg));
+  BOOST_REQUIRE_EQUAL(restored.dataSizeBytes(), frag.dataSizeBytes());
+  BOOST_REQUIRE(std::equal(frag.dataBeginBytes(),
+                           frag.dataBeginBytes() + frag.dataSizeBytes(),
+                           restored.dataBeginBytes()));
+
+  artdaq::Fragment compfrg(dune::FelixCompress(reordfrg));
+  artdaq::Fragment decompressed(dune::FelixRestore(compfrg));
+  BOOST_REQUIRE(std::equal(frag.dataBeginBytes(),
+                           frag.dataBeginBytes() + frag.dataSizeBytes(),
+                           decompressed.dataBeginBytes()));
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(StreamReorderTest) {
+  std::cout << "### MEOW -> Testing reordering frames as they arrive...\n";
+
+  const size_t frames = 1000;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  std::srand(50);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+
+  // Chunks of uneven length into a fragment with room to spare.
+  dune::FelixStreamReorderer reorderer(1200);
+  const size_t chunks[] = {128, 300, 37, 512, 23};
+  size_t added = 0;
+  for (size_t n : chunks) {
+    reorderer.add_frames(
+        frag.dataBeginBytes() + added * sizeof(dune::FelixFrame), n);
+    added += n;
+  }
+  BOOST_REQUIRE_EQUAL(reorderer.num_frames(), frames);
+  BOOST_CHECK_THROW(reorderer.add_frames(frag.dataBeginBytes(), 201),
+                    cet::exception);
+
+  artdaq::Fragment streamed(reorderer.finish());
+  dune::FelixFragment flxfrg(streamed, 1);
+  BOOST_REQUIRE_EQUAL(flxfrg.total_frames(), frames);
+  artdaq::Fragment restored(dune::FelixRestore(streamed));
+  BOOST_REQUIRE(std::equal(frag.dataBeginBytes(),
+                           frag.dataBeginBytes() + frag.dataSizeBytes(),
+                           restored.dataBeginBytes()));
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(CrcTest) {
+  std::cout << "### MEOW -> Testing CRC32 verification...\n";
+
+  const char check[] = "123456789";
+  BOOST_REQUIRE_EQUAL(dune::FelixCrc32()(check, 9), 0xCBF43926u);
+  BOOST_REQUIRE_EQUAL(
+      dune::FelixCrc32(dune::FelixCrc32::castagnoli_polynomial)(check, 9),
+      0xE3069283u);
+
+  const size_t frames = 3000;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  std::srand(51);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+  dune::FelixFrame* frm =
+      reinterpret_cast<dune::FelixFrame*>(frag.dataBeginBytes());
+  const dune::FelixCrc32 crc;
+  for (size_t i = 0; i < frames; ++i) {
+    frm[i].set_CRC32(crc.frame_crc(frm[i]));
+  }
+  const size_t corrupt[] = {0, 63, 64, 1500, 2999};
+  for (size_t i : corrupt) {
+    frm[i].set_channel(i % 256, frm[i].channel(i % 256) ^ 1);
+  }
+
+  dune::FelixFragment flxfrg(frag);
+  const dune::FelixFrameBitmap bad = dune::verify_crc(flxfrg);
+  BOOST_REQUIRE_EQUAL(bad.size(), frames);
+  BOOST_REQUIRE_EQUAL(bad.count(), 5u);
+  for (size_t i : corrupt) BOOST_REQUIRE(bad.test(i));
+
+  artdaq::Fragment reordfrg(dune::FelixReorder(frag.dataBeginBytes(), frames));
+  dune::FelixFragment reordflxfrg(reordfrg, 1);
+  BOOST_REQUIRE_EQUAL(dune::verify_crc(reordflxfrg).count(), 5u);
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(ChecksumTest) {
+  std::cout << "### MEOW -> Testing COLDATA checksum validation...\n";
+
+  const size_t frames = 2000;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  std::srand(52);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+  dune::FelixFrame* frm =
+      reinterpret_cast<dune::FelixFrame*>(frag.dataBeginBytes());
+  for (size_t i = 0; i < frames; ++i) {
+    for (unsigned b = 0; b < 4; ++b) {
+      // Reference: plain Fletcher-style sums over the 16-bit ADC words.
+      const uint8_t* adcs = frag.dataBeginBytes() +
+                            i * sizeof(dune::FelixFrame) +
+                            dune::felix_coldata_adc_offset +
+                            b * dune::felix_coldata_block_bytes;
+      uint16_t a = 0, c = 0;
+      for (unsigned k = 0; k < 48; ++k) {
+        a += adcs[2 * k] | adcs[2 * k + 1] << 8;
+        c += a;
+      }
+      frm[i].set_checksum_a(b, a);
+      frm[i].set_checksum_b(b, c);
+    }
+  }
+  frm[5].set_channel(70, frm[5].channel(70) ^ 0x10);  // block 1
+  frm[1999].set_checksum_b(3, frm[1999].checksum_b(3) + 1);
+
+  dune::FelixFragment flxfrg(frag);
+  const dune::FelixFrameBitmap bad = dune::validate_checksums(flxfrg);
+  BOOST_REQUIRE_EQUAL(bad.size(), 4 * frames);
+  BOOST_REQUIRE_EQUAL(bad.count(), 2u);
+  BOOST_REQUIRE(bad.test(5 * 4 + 1));
+  BOOST_REQUIRE(bad.test(1999 * 4 + 3));
+
+  // Validation during decoding gives the same blocks and the same ADCs.
+  std::vector<dune::adc_t> expected(frames * 256);
+  std::vector<dune::adc_t> decoded(frames * 256);
+  flxfrg.decode_all(expected.data(), frames);
+  const dune::FelixFrameBitmap bad_decoded =
+      dune::decode_and_validate(frm, frames, decoded.data(), frames);
+  BOOST_REQUIRE(expected == decoded);
+  BOOST_REQUIRE_EQUAL(bad_decoded.count(), 2u);
+  BOOST_REQUIRE(bad_decoded.test(5 * 4 + 1));
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+// Raw frames captured from a WIB: FELIX_WIB_CAPTURE, or the capture that
+// BaselineTest uses.
+static const char* felix_wib_capture() {
+  const char* path = std::getenv("FELIX_WIB_CAPTURE");
+  return path ? path
+              : "/afs/cern.ch/work/m/mivermeu/private/dune-raw-data/frames/"
+                "FelixCounter.frame";
+}
+
+static boost::test_tools::assertion_result felix_wib_capture_available(
+    boost::unit_test::test_unit_id) {
+  boost::test_tools::assertion_result available(
+      std::ifstream(felix_wib_capture()).good());
+  available.message() << "no WIB capture at " << felix_wib_capture()
+                      << "; the COLDATA checksum algorithm is unverified";
+  return available;
+}
+
+// The checksum algorithm in FelixChecksum.hh is assumed. Frames written by a
+// real WIB must all pass it. Without a capture the test is reported as
+// skipped rather than passed.
+BOOST_AUTO_TEST_CASE(CaptureChecksumTest,
+                     *boost::unit_test::precondition(
+                         felix_wib_capture_available)) {
+  std::cout << "### MEOW -> Testing COLDATA checksums of a WIB capture...\n";
+
+  std::ifstream in(felix_wib_capture(), std::ios::binary);
+  const std::string contents((std::istreambuf_iterator<char>(in)),
+                             (std::istreambuf_iterator<char>()));
+  BOOST_REQUIRE_GE(contents.size(), sizeof(dune::FelixFrame));
+  const size_t frames = contents.size() / sizeof(dune::FelixFrame);
+  std::vector<dune::FelixFrame> buf(frames);
+  memcpy(buf.data(), contents.data(), frames * sizeof(dune::FelixFrame));
+  const dune::FelixFrameBitmap bad =
+      dune::validate_checksums(buf.data(), frames);
+  BOOST_REQUIRE_EQUAL(bad.count(), 0u);
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(TimestampScanTest) {
+  std::cout << "### MEOW -> Testing the timestamp continuity scan...\n";
+
+  const size_t frames = 1000;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  std::srand(53);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+  dune::FelixFrame* frm =
+      reinterpret_cast<dune::FelixFrame*>(frag.dataBeginBytes());
+  uint64_t t = 0x123456789ab;
+  for (size_t i = 0; i < frames; ++i) {
+    if (i == 100) t += 3 * 25;  // Three frames missing.
+    if (i == 201 || i == 202) t -= 25;  // Two repeated frames.
+    if (i == 300) t -= 1000;  // Jump back.
+    frm[i].set_z(i % 3 == 0);
+    frm[i].set_timestamp(t);
+    t += 25;
+  }
+
+  dune::FelixFragment flxfrg(frag);
+  const std::vector<uint64_t> timestamps = dune::gather_timestamps(flxfrg);
+  for (size_t i = 0; i < frames; ++i) {
+    BOOST_REQUIRE_EQUAL(timestamps[i], flxfrg.timestamp(i));
+  }
+
+  const std::vector<dune::FelixTimestampIssue> issues =
+      dune::scan_timestamps(flxfrg);
+  BOOST_REQUIRE_EQUAL(issues.size(), 3u);
+  BOOST_CHECK_EQUAL(issues[0].kind, dune::FelixTimestampIssue::gap);
+  BOOST_CHECK_EQUAL(issues[0].first_frame, 100u);
+  BOOST_CHECK_EQUAL(issues[0].step, 4 * 25);
+  BOOST_CHECK_EQUAL(issues[1].kind, dune::FelixTimestampIssue::duplicate);
+  BOOST_CHECK_EQUAL(issues[1].first_frame, 201u);
+  BOOST_CHECK_EQUAL(issues[1].num_steps, 2u);
+  BOOST_CHECK_EQUAL(issues[2].kind, dune::FelixTimestampIssue::out_of_order);
+  BOOST_CHECK_EQUAL(issues[2].first_frame, 300u);
+
+  // The reordered layout gives the same timestamps.
+  artdaq::Fragment reordfrg(dune::FelixReorder(frag.dataBeginBytes(), frames));
+  dune::FelixFragment reordflxfrg(reordfrg, 1);
+  BOOST_REQUIRE(dune::gather_timestamps(reordflxfrg) == timestamps);
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(WindowTest) {
+  std::cout << "### MEOW -> Testing timestamp windows...\n";
+
+  const size_t frames = 2000;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  std::srand(54);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+  dune::FelixFrame* frm =
+      reinterpret_cast<dune::FelixFrame*>(frag.dataBeginBytes());
+  const uint64_t t0 = 1000000;
+  for (size_t i = 0; i < frames; ++i) {
+    frm[i].set_z(0);
+    frm[i].set_timestamp(t0 + 25 * i);
+  }
+  artdaq::Fragment reordfrg(dune::FelixReorder(frag.dataBeginBytes(), frames));
+  artdaq::Fragment compfrg(dune::FelixCompress(reordfrg));
+
+  const dune::FelixFragment flxfrg(frag);
+  const dune::FelixFragment layouts[] = {
+      flxfrg, dune::FelixFragment(reordfrg, 1),
+      dune::FelixFragment(compfrg, 1)};
+  const dune::adc_v waveform = flxfrg.get_ADCs_by_channel(7);
+  const std::vector<uint64_t> timestamps = dune::gather_timestamps(flxfrg);
+  // Frames 400 up to and including 699.
+  const uint64_t t_begin = t0 + 25 * 400 - 10;
+  const uint64_t t_end = t0 + 25 * 699 + 1;
+  for (const dune::FelixFragment& f : layouts) {
+    const dune::FelixFragment win = f.window(t_begin, t_end);
+    BOOST_REQUIRE_EQUAL(win.total_frames(), 300u);
+    for (size_t i = 0; i < win.total_frames(); i += 3) {
+      BOOST_REQUIRE_EQUAL(win.timestamp(i), flxfrg.timestamp(400 + i));
+      BOOST_REQUIRE_EQUAL(win.CRC32(i), flxfrg.CRC32(400 + i));
+      BOOST_REQUIRE_EQUAL(win.checksum_b(i, 2), flxfrg.checksum_b(400 + i, 2));
+      BOOST_REQUIRE_EQUAL(win.get_ADC(i, 200), flxfrg.get_ADC(400 + i, 200));
+    }
+    BOOST_REQUIRE(win.get_ADCs_by_channel(7) ==
+                  dune::adc_v(waveform.begin() + 400, waveform.begin() + 700));
+    BOOST_REQUIRE(dune::gather_timestamps(win) ==
+                  std::vector<uint64_t>(timestamps.begin() + 400,
+                                        timestamps.begin() + 700));
+    // Windows of windows and empty windows.
+    BOOST_REQUIRE_EQUAL(win.window(t0 + 25 * 500, t0 + 25 * 510).timestamp(0),
+                        t0 + 25 * 500);
+    BOOST_REQUIRE_EQUAL(f.window(t0 - 100, t0).total_frames(), 0u);
+    BOOST_REQUIRE_EQUAL(f.window(t_end, t_begin).total_frames(), 0u);
+  }
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(FileMapTest) {
+  std::cout << "### MEOW -> Testing memory-mapped capture files...\n";
+
+  const size_t frames = 2500;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  std::srand(55);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+  char path[] = "/tmp/felix_capture_XXXXXX";
+  const int fd = mkstemp(path);
+  BOOST_REQUIRE(fd >= 0);
+  BOOST_REQUIRE_EQUAL(
+      write(fd, frag.dataBeginBytes(), frag.dataSizeBytes()),
+      ssize_t(frag.dataSizeBytes()));
+  close(fd);
+
+  {
+    const dune::FelixFileMap file(path, true);
+    BOOST_REQUIRE_EQUAL(file.num_frames(), frames);
+    BOOST_REQUIRE(std::equal(frag.dataBeginBytes(),
+                             frag.dataBeginBytes() + frag.dataSizeBytes(),
+                             file.data()));
+    const size_t per_fragment = 1000;
+    BOOST_REQUIRE_EQUAL(file.num_fragments(per_fragment), 3u);
+    const dune::FelixFragment flxfrg(frag);
+    for (size_t f = 0; f < file.num_fragments(per_fragment); ++f) {
+      file.prefetch((f + 1) * per_fragment, per_fragment);
+      const dune::FelixFragment view = file.fragment(f, per_fragment);
+      BOOST_REQUIRE_EQUAL(view.total_frames(), f < 2 ? 1000u : 500u);
+      for (size_t i = 0; i < view.total_frames(); i += 11) {
+        BOOST_REQUIRE_EQUAL(view.timestamp(i),
+                            flxfrg.timestamp(f * per_fragment + i));
+        BOOST_REQUIRE_EQUAL(view.get_ADC(i, 99),
+                            flxfrg.get_ADC(f * per_fragment + i, 99));
+      }
+    }
+  }
+
+  artdaq::FragmentPtr read = dune::FelixFragmentBase::fromFile(path);
+  BOOST_REQUIRE_EQUAL(read->dataSizeBytes(), frag.dataSizeBytes());
+  BOOST_REQUIRE(std::equal(frag.dataBeginBytes(),
+                           frag.dataBeginBytes() + frag.dataSizeBytes(),
+                           read->dataBeginBytes()));
+  unlink(path);
+
+  BOOST_CHECK_THROW(dune::FelixFileMap("/nonexistent/capture.bin"),
+                    cet::exception);
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(ApaAssemblyTest) {
+  std::cout << "### MEOW -> Testing APA assembly of FELIX links...\n";
+
+  // Ten links of one crate, two fibers per slot; the second half of the links
+  // is reordered.
+  const size_t frames = 600;
+  const unsigned num_links = 10;
+  std::vector<artdaq::Fragment> raw(num_links);
+  std::vector<artdaq::Fragment> reord;
+  std::vector<dune::FelixFragment> links;
+  std::srand(56);
+  for (unsigned l = 0; l < num_links; ++l) {
+    raw[l].resizeBytes(frames * sizeof(dune::FelixFrame));
+    for (size_t i = 0; i < raw[l].dataSizeBytes(); ++i) {
+      raw[l].dataBeginBytes()[i] = std::rand() & 0xff;
+    }
+    dune::FelixFrame* frm =
+        reinterpret_cast<dune::FelixFrame*>(raw[l].dataBeginBytes());
+    for (size_t i = 0; i < frames; ++i) {
+      frm[i].set_crate_no(3);
+      frm[i].set_slot_no(l / 2);
+      frm[i].set_fiber_no(1 + l % 2);
+    }
+  }
+  reord.reserve(num_links);
+  for (unsigned l = 0; l < num_links; ++l) {
+    if (l < num_links / 2) {
+      links.push_back(dune::FelixFragment(raw[l]));
+    } else {
+      reord.push_back(dune::FelixReorder(raw[l].dataBeginBytes(), frames));
+      links.push_back(dune::FelixFragment(reord.back(), 1));
+    }
+  }
+
+  // Channels of a link are reversed and offset by 1000; slot 4 fiber 2 maps
+  // half of its channels outside of the APA.
+  auto mapper = [](unsigned crate, unsigned slot, unsigned fiber,
+                   unsigned ch) -> unsigned {
+    BOOST_CHECK_EQUAL(crate, 3u);
+    const unsigned link = slot * 2 + fiber - 1;
+    return 1000 + link * 256 + 255 - ch;
+  };
+  dune::FelixApaAssembler assembler(mapper, 1000, 2560 - 128);
+  size_t stride;
+  const dune::adc_v matrix = assembler.assemble(links, stride);
+  BOOST_REQUIRE_EQUAL(stride, frames);
+  for (unsigned l = 0; l < num_links; ++l) {
+    for (unsigned ch = 0; ch < 256; ++ch) {
+      const unsigned row = l * 256 + 255 - ch;
+      if (row >= assembler.num_channels()) continue;
+      for (size_t t = 0; t < frames; t += 13) {
+        BOOST_REQUIRE_EQUAL(matrix[row * stride + t],
+                            links[l].get_ADC(t, ch));
+      }
+    }
+  }
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(HitFinderTest) {
+  std::cout << "### MEOW -> Testing FELIX hit finding...\n";
+
+  // Noisy pedestals with a triangular pulse on every seventh channel.
+  const size_t frames = 1000;
+  const dune::adc_t threshold = 20;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  dune::FelixFrame* frm =
+      reinterpret_cast<dune::FelixFrame*>(frag.dataBeginBytes());
+  std::srand(57);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+  for (size_t i = 0; i < frames; ++i) {
+    for (unsigned ch = 0; ch < 256; ++ch) {
+      int adc = 400 + ch + std::rand() % 5 - 2;
+      const int t = int(i) - 100 - int(ch);
+      if (ch % 7 == 0 && t >= 0 && t < 20) adc += 60 - 6 * std::abs(t - 10);
+      frm[i].set_channel(ch, adc);
+    }
+  }
+
+  // Scalar reference of the same algorithm.
+  std::vector<dune::FelixHit> expected;
+  {
+    std::vector<int> ped(256);
+    std::vector<bool> in_hit(256, false);
+    std::vector<dune::FelixHit> open(256);
+    for (unsigned ch = 0; ch < 256; ++ch) ped[ch] = frm[0].channel(ch);
+    for (size_t i = 0; i < frames; ++i) {
+      for (unsigned ch = 0; ch < 256; ++ch) {
+        const int a = frm[i].channel(ch);
+        const int v = a - ped[ch];
+        if (v > threshold) {
+          if (!in_hit[ch]) open[ch] = dune::FelixHit{uint16_t(ch), i, 0, 0, 0};
+          in_hit[ch] = true;
+          ++open[ch].time_over_threshold;
+          open[ch].peak = std::max<int>(open[ch].peak, v);
+          open[ch].integral += v;
+          continue;
+        }
+        ped[ch] += (a > ped[ch]) - (a < ped[ch]);
+        if (in_hit[ch]) expected.push_back(open[ch]);
+        in_hit[ch] = false;
+      }
+    }
+  }
+  BOOST_REQUIRE_EQUAL(expected.size(), 256u / 7 + 1);
+
+  auto check = [&](const std::vector<dune::FelixHit>& hits) {
+    BOOST_REQUIRE_EQUAL(hits.size(), expected.size());
+    for (size_t h = 0; h < hits.size(); ++h) {
+      BOOST_CHECK_EQUAL(hits[h].channel, expected[h].channel);
+      BOOST_CHECK_EQUAL(hits[h].start_tick, expected[h].start_tick);
+      BOOST_CHECK_EQUAL(hits[h].time_over_threshold,
+                        expected[h].time_over_threshold);
+      BOOST_CHECK_EQUAL(hits[h].peak, expected[h].peak);
+      BOOST_CHECK_EQUAL(hits[h].integral, expected[h].integral);
+    }
+  };
+
+  // Raw frames, fed in uneven batches.
+  dune::FelixHitFinder finder(threshold);
+  std::vector<dune::FelixHit> hits;
+  for (size_t fr = 0; fr < frames; fr += 77) {
+    finder.process(frm + fr, std::min<size_t>(77, frames - fr), hits);
+  }
+  finder.flush(hits);
+  BOOST_CHECK_EQUAL(finder.tick(), frames);
+  check(hits);
+
+  // Reordered fragment.
+  artdaq::Fragment reord = dune::FelixReorder(frag.dataBeginBytes(), frames);
+  dune::FelixHitFinder reord_finder(threshold);
+  std::vector<dune::FelixHit> reord_hits;
+  reord_finder.process(dune::FelixFragment(reord, 1), reord_hits);
+  reord_finder.flush(reord_hits);
+  check(reord_hits);
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(MonitorTest) {
+  std::cout << "### MEOW -> Testing FELIX link monitoring...\n";
+
+  const size_t frames = 500;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  std::srand(58);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+  const dune::FelixFragment flxfrg(frag);
+  artdaq::Fragment reord = dune::FelixReorder(frag.dataBeginBytes(), frames);
+  const dune::FelixFragment reordfrg(reord, 1);
+
+  // Four threads ingest the fragment three times each, in either layout,
+  // while snapshots are taken.
+  dune::FelixMonitor monitor;
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t]() {
+      for (unsigned k = 0; k < 3; ++k) {
+        monitor.ingest((t + k) % 2 ? reordfrg : flxfrg);
+      }
+    });
+  }
+  for (unsigned k = 0; k < 5; ++k) {
+    const dune::FelixMonitor::Snapshot snap = monitor.snapshot();
+    BOOST_CHECK_EQUAL(snap.channel(0).count % frames, 0u);
+  }
+  for (auto& t : threads) t.join();
+
+  const dune::FelixMonitor::Snapshot snap = monitor.snapshot();
+  for (unsigned ch = 0; ch < 256; ++ch) {
+    double sum = 0, sum_sq = 0;
+    dune::adc_t mn = 0xffff, mx = 0;
+    std::vector<uint64_t> hist(4096, 0);
+    for (size_t i = 0; i < frames; ++i) {
+      const dune::adc_t a = flxfrg.get_ADC(i, ch);
+      sum += a;
+      sum_sq += double(a) * a;
+      mn = std::min(mn, a);
+      mx = std::max(mx, a);
+      hist[a] += 12;
+    }
+    const double mean = sum / frames;
+    const double rms = std::sqrt(sum_sq / frames - mean * mean);
+    const dune::FelixMonitor::ChannelStats& s = snap.channel(ch);
+    BOOST_REQUIRE_EQUAL(s.count, 12 * frames);
+    BOOST_CHECK_CLOSE(s.mean, mean, 1e-9);
+    BOOST_CHECK_CLOSE(s.rms, rms, 1e-6);
+    BOOST_CHECK_EQUAL(s.min, mn);
+    BOOST_CHECK_EQUAL(s.max, mx);
+    BOOST_CHECK(std::equal(hist.begin(), hist.end(), snap.histogram(ch)));
+  }
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(StuckCodeTest) {
+  std::cout << "### MEOW -> Testing stuck code detection...\n";
+
+  // Every channel is a unit ramp, so that stuck codes come in pairs (63, 64)
+  // that interpolation restores exactly. Channel 7 has bit 2 stuck at one.
+  const size_t frames = 1000;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  dune::FelixFrame* frm =
+      reinterpret_cast<dune::FelixFrame*>(frag.dataBeginBytes());
+  std::srand(59);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+  std::vector<uint64_t> expected(256, 0);
+  for (size_t i = 0; i < frames; ++i) {
+    for (unsigned ch = 0; ch < 256; ++ch) {
+      dune::adc_t adc = 100 + ch + i;
+      if (ch == 7) adc |= 4;
+      frm[i].set_channel(ch, adc);
+      expected[ch] += dune::FelixStuckCodeDetector::is_stuck(adc);
+    }
+  }
+
+  dune::FelixStuckCodeDetector detector;
+  dune::adc_v decoded(256 * frames);
+  detector.decode(frm, frames, decoded.data(), frames);
+  BOOST_CHECK_EQUAL(detector.samples(), frames);
+  for (unsigned ch = 0; ch < 256; ++ch) {
+    BOOST_REQUIRE_EQUAL(detector.stuck_count(ch), expected[ch]);
+    BOOST_CHECK_EQUAL(detector.stuck_bits(ch) & 0x3f, ch == 7 ? 4 : 0);
+    for (size_t i = 0; i < frames; i += 7) {
+      BOOST_REQUIRE_EQUAL(decoded[ch * frames + i], frm[i].channel(ch));
+    }
+  }
+  const std::vector<unsigned> flagged = detector.flagged_channels(0.05);
+  BOOST_REQUIRE_EQUAL(flagged.size(), 1u);
+  BOOST_CHECK_EQUAL(flagged[0], 7u);
+
+  // Mitigation, on both layouts, a compressed fragment and a frame table.
+  artdaq::Fragment reord = dune::FelixReorder(frag.dataBeginBytes(), frames);
+  artdaq::Fragment comp = dune::FelixCompress(reord);
+  std::vector<size_t> offsets(frames);
+  for (size_t i = 0; i < frames; ++i) offsets[i] = i * sizeof(dune::FelixFrame);
+  const dune::FelixFragment flxfrg(frag);
+  const dune::FelixFragment reordfrg(reord, 1);
+  const dune::FelixFragment compfrg(comp, 1);
+  const dune::FelixFragment tablefrg(frag.dataBeginBytes(),
+                                     frag.dataSizeBytes(), offsets);
+  for (const dune::FelixFragment* f :
+       {&flxfrg, &reordfrg, &compfrg, &tablefrg}) {
+    dune::FelixStuckCodeDetector mitigator(true);
+    const size_t stride = frames + 24;
+    dune::adc_v fixed(256 * stride);
+    mitigator.decode(*f, fixed.data(), stride);
+    BOOST_REQUIRE_EQUAL(mitigator.samples(), frames);
+    for (unsigned ch = 0; ch < 256; ++ch) {
+      BOOST_REQUIRE_EQUAL(mitigator.stuck_count(ch), expected[ch]);
+      if (ch == 7) continue;
+      for (size_t i = 2; i < frames - 2; ++i) {
+        BOOST_REQUIRE_EQUAL(fixed[ch * stride + i], 100 + ch + i);
+      }
+    }
+  }
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(ChannelTableTest) {
+  std::cout << "### MEOW -> Testing table driven channel access...\n";
+
+  static_assert(dune::felix_channel_offset(0) == 32, "channel 0 offset");
+  static_assert(dune::felix_channel_offset(255) == 461, "channel 255 offset");
+
+  // Compare against the bit field accessors of the COLDATA segments.
+  const size_t frames = 50;
+  std::vector<dune::FelixFrame> buf(frames);
+  uint8_t* bytes = reinterpret_cast<uint8_t*>(buf.data());
+  std::srand(60);
+  for (size_t i = 0; i < frames * sizeof(dune::FelixFrame); ++i) {
+    bytes[i] = std::rand() & 0xff;
+  }
+  for (size_t fr = 0; fr < frames; ++fr) {
+    const dune::FelixFrame& f = buf[fr];
+    for (unsigned ch = 0; ch < 256; ++ch) {
+      const uint16_t expected = f.channel(ch / 64, ch % 64 / 8, ch % 8);
+      BOOST_REQUIRE_EQUAL(f.channel(ch), expected);
+      BOOST_REQUIRE_EQUAL(f.channel(ch / 64, ch % 64), expected);
+    }
+    BOOST_CHECK_EQUAL(f.channel<0>(), f.channel(0, 0, 0));
+    BOOST_CHECK_EQUAL(f.channel<1>(), f.channel(0, 0, 1));
+    BOOST_CHECK_EQUAL(f.channel<77>(), f.channel(1, 1, 5));
+    BOOST_CHECK_EQUAL(f.channel<138>(), f.channel(2, 1, 2));
+    BOOST_CHECK_EQUAL(f.channel<255>(), f.channel(3, 7, 7));
+  }
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(Packed12Test) {
+  std::cout << "### MEOW -> Testing 12-bit packed reordered data...\n";
+
+  // Row kernels, for every tail length.
+  std::srand(61);
+  for (size_t n = 0; n < 70; ++n) {
+    dune::adc_v in(n), out(n);
+    for (auto& v : in) v = std::rand() & 0xfff;
+    std::vector<uint8_t> packed(dune::FelixPacked12::bytes(n) + 1, 0xab);
+    dune::FelixPacked12::pack(in.data(), n, packed.data());
+    BOOST_REQUIRE_EQUAL(packed.back(), 0xab);
+    dune::FelixPacked12::unpack(packed.data(), n, out.data());
+    BOOST_REQUIRE(in == out);
+    for (size_t i = 0; i < n; ++i) {
+      BOOST_REQUIRE_EQUAL(dune::FelixPacked12::value(packed.data(), i), in[i]);
+    }
+  }
+
+  const size_t frames = 1001;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+  artdaq::Fragment raw = dune::FelixReorder(frag.dataBeginBytes(), frames);
+  artdaq::Fragment packed =
+      dune::FelixReorder(frag.dataBeginBytes(), frames,
+                         dune::ReorderedFelixFrames::adc_packed12);
+
+  // Packed rows take three quarters of the raw ones, and re-encoding a raw
+  // reordered fragment gives the same bytes.
+  const dune::ReorderedFelixFrames::Header& raw_head =
+      reinterpret_cast<const dune::ReorderedFelixFrames*>(
+          raw.dataBeginBytes())->header();
+  const dune::ReorderedFelixFrames::Header& packed_head =
+      reinterpret_cast<const dune::ReorderedFelixFrames*>(
+          packed.dataBeginBytes())->header();
+  BOOST_CHECK_EQUAL(4 * packed_head.adc_bytes, 3 * raw_head.adc_bytes);
+  BOOST_CHECK_EQUAL(raw.dataSizeBytes() - packed.dataSizeBytes(),
+                    raw_head.adc_bytes / 4);
+  artdaq::Fragment encoded =
+      dune::FelixEncode(raw, dune::ReorderedFelixFrames::adc_packed12);
+  BOOST_REQUIRE_EQUAL(encoded.dataSizeBytes(), packed.dataSizeBytes());
+  BOOST_CHECK(std::equal(packed.dataBeginBytes(),
+                         packed.dataBeginBytes() + packed.dataSizeBytes(),
+                         encoded.dataBeginBytes()));
+
+  const dune::FelixFragment flxfrg(frag);
+  const dune::FelixFragment packfrg(packed, 1);
+  BOOST_REQUIRE_EQUAL(packfrg.total_frames(), frames);
+  for (unsigned ch = 0; ch < 256; ch += 5) {
+    const dune::adc_v row = packfrg.get_ADCs_by_channel(ch);
+    for (size_t i = 0; i < frames; i += 3) {
+      BOOST_REQUIRE_EQUAL(packfrg.get_ADC(i, ch), flxfrg.get_ADC(i, ch));
+      BOOST_REQUIRE_EQUAL(row[i], flxfrg.get_ADC(i, ch));
+    }
+  }
+
+  artdaq::Fragment restored = dune::FelixRestore(packed);
+  BOOST_REQUIRE_EQUAL(restored.dataSizeBytes(), frag.dataSizeBytes());
+  BOOST_CHECK(std::equal(frag.dataBeginBytes(),
+                         frag.dataBeginBytes() + frag.dataSizeBytes(),
+                         restored.dataBeginBytes()));
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(BlockForTest) {
+  std::cout << "### MEOW -> Testing block frame of reference encoding...\n";
+
+  // Noisy pedestals with a pulse on every tenth channel, which gives every
+  // block a few exceptions. 1001 frames leave a partial last block.
+  const size_t frames = 1001;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  dune::FelixFrame* frm =
+      reinterpret_cast<dune::FelixFrame*>(frag.dataBeginBytes());
+  std::srand(67);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+  for (size_t i = 0; i < frames; ++i) {
+    for (unsigned ch = 0; ch < 256; ++ch) {
+      dune::adc_t adc = 500 + 3 * ch + std::rand() % 8;
+      if (ch % 10 == 0 && i % 300 >= 100 && i % 300 < 104) adc += 1500;
+      frm[i].set_channel(ch, adc);
+    }
+  }
+  artdaq::Fragment raw = dune::FelixReorder(frag.dataBeginBytes(), frames);
+  artdaq::Fragment comp =
+      dune::FelixEncode(raw, dune::ReorderedFelixFrames::adc_block_for);
+  const dune::ReorderedFelixFrames::Header& raw_head =
+      reinterpret_cast<const dune::ReorderedFelixFrames*>(
+          raw.dataBeginBytes())->header();
+  const dune::ReorderedFelixFrames::Header& comp_head =
+      reinterpret_cast<const dune::ReorderedFelixFrames*>(
+          comp.dataBeginBytes())->header();
+  BOOST_CHECK_EQUAL(comp_head.adc_encoding,
+                    dune::ReorderedFelixFrames::adc_block_for);
+  BOOST_CHECK_LT(4 * comp_head.adc_bytes, raw_head.adc_bytes);
+  std::cout << "Block coded ADC section: " << comp_head.adc_bytes << " of "
+            << raw_head.adc_bytes << " bytes.\n";
+
+  const dune::FelixFragment flxfrg(frag);
+  const dune::FelixFragment compfrg(comp, 1);
+  BOOST_REQUIRE_EQUAL(compfrg.total_frames(), frames);
+  for (unsigned ch = 0; ch < 256; ch += 5) {
+    const dune::adc_v row = compfrg.get_ADCs_by_channel(ch);
+    for (size_t i = 0; i < frames; ++i) {
+      BOOST_REQUIRE_EQUAL(row[i], flxfrg.get_ADC(i, ch));
+    }
+    for (size_t i = 0; i < frames; i += 3) {
+      BOOST_REQUIRE_EQUAL(compfrg.get_ADC(i, ch), flxfrg.get_ADC(i, ch));
+    }
+  }
+
+  // Views across block boundaries decode only their own frames.
+  const size_t first[] = {0, 500, 511, 512, 1000};
+  const size_t count[] = {1, 13, 2, 489, 1};
+  for (unsigned k = 0; k < 5; ++k) {
+    const dune::FelixFragment view = compfrg.frame_range(first[k], count[k]);
+    BOOST_REQUIRE_EQUAL(view.total_frames(), count[k]);
+    for (unsigned ch = 0; ch < 256; ch += 7) {
+      const dune::adc_v row = view.get_ADCs_by_channel(ch);
+      for (size_t i = 0; i < count[k]; ++i) {
+        BOOST_REQUIRE_EQUAL(row[i], flxfrg.get_ADC(first[k] + i, ch));
+        BOOST_REQUIRE_EQUAL(view.get_ADC(i, ch),
+                            flxfrg.get_ADC(first[k] + i, ch));
+      }
+    }
+  }
+
+  artdaq::Fragment restored = dune::FelixRestore(comp);
+  BOOST_REQUIRE_EQUAL(restored.dataSizeBytes(), frag.dataSizeBytes());
+  BOOST_CHECK(std::equal(frag.dataBeginBytes(),
+                         frag.dataBeginBytes() + frag.dataSizeBytes(),
+                         restored.dataBeginBytes()));
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(CompactHeadersTest) {
+  std::cout << "### MEOW -> Testing compact reordered headers...\n";
+
+  // Link constants, a 25-tick timestamp stride with a glitch and a gap,
+  // counting convert counts, a short burst of errors and random checksums.
+  const size_t frames = 2000;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  uint8_t* bytes = frag.dataBeginBytes();
+  std::srand(71);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    bytes[i] = std::rand() & 0xff;
+  }
+  dune::FelixFrame* frm = reinterpret_cast<dune::FelixFrame*>(bytes);
+  for (size_t i = 0; i < frames; ++i) {
+    uint8_t* f = bytes + i * sizeof(dune::FelixFrame);
+    memset(f, 0, 16);
+    for (unsigned b = 0; b < 4; ++b) memset(f + 16 + b * 112, 0, 16);
+    frm[i].set_sof(0x3c);
+    frm[i].set_version(3);
+    frm[i].set_crate_no(5);
+    frm[i].set_slot_no(2);
+    frm[i].set_fiber_no(1);
+    if (i >= 100 && i < 103) frm[i].set_wib_errors(0x11);
+    uint64_t ts = 0x123456789aULL + 25 * i;
+    if (i == 500) ts += 3;
+    if (i >= 800) ts += 1000;
+    frm[i].set_timestamp(ts);
+    for (unsigned b = 0; b < 4; ++b) {
+      frm[i].set_coldata_convert_count(b, i + 7 * b);
+      frm[i].set_checksum_a(b, std::rand() & 0xffff);
+      frm[i].set_checksum_b(b, std::rand() & 0xffff);
+      frm[i].set_hdr(b, 3, 9);
+      if (b == 2 && i >= 300 && i < 310) frm[i].set_error_register(b, 5);
+    }
+  }
+
+  artdaq::Fragment raw = dune::FelixReorder(bytes, frames);
+  artdaq::Fragment compact = dune::FelixCompactHeaders(raw);
+  const dune::ReorderedFelixFrames* cf =
+      reinterpret_cast<const dune::ReorderedFelixFrames*>(
+          compact.dataBeginBytes());
+  BOOST_REQUIRE_EQUAL(cf->header().header_encoding,
+                      dune::ReorderedFelixFrames::headers_compact);
+  // Only the checksums are kept per frame, four bytes per block.
+  const size_t column_bytes =
+      cf->header().crc32_offset - cf->header().wib_headers_offset;
+  std::cout << "Header columns: " << column_bytes << " bytes for " << frames
+            << " frames.\n";
+  BOOST_CHECK_LT(column_bytes, 16 * frames + 1024);
+  BOOST_CHECK_GT(raw.dataSizeBytes() - compact.dataSizeBytes(), 63 * frames);
+
+  const dune::FelixFragment flxfrg(frag);
+  const dune::FelixFragment compfrg(compact, 1);
+  BOOST_REQUIRE_EQUAL(compfrg.total_frames(), frames);
+  for (size_t i = 0; i < frames; ++i) {
+    BOOST_REQUIRE_EQUAL(compfrg.timestamp(i), flxfrg.timestamp(i));
+    BOOST_REQUIRE_EQUAL(compfrg.wib_errors(i), flxfrg.wib_errors(i));
+    BOOST_REQUIRE_EQUAL(compfrg.crate_no(i), 5);
+    BOOST_REQUIRE_EQUAL(compfrg.CRC32(i), flxfrg.CRC32(i));
+    for (unsigned b = 0; b < 4; ++b) {
+      BOOST_REQUIRE_EQUAL(compfrg.checksum_a(i, b), flxfrg.checksum_a(i, b));
+      BOOST_REQUIRE_EQUAL(compfrg.checksum_b(i, b), flxfrg.checksum_b(i, b));
+      BOOST_REQUIRE_EQUAL(compfrg.coldata_convert_count(i, b),
+                          flxfrg.coldata_convert_count(i, b));
+      BOOST_REQUIRE_EQUAL(compfrg.error_register(i, b),
+                          flxfrg.error_register(i, b));
+    }
+  }
+  BOOST_CHECK(dune::gather_timestamps(compfrg) ==
+              dune::gather_timestamps(flxfrg));
+  const dune::FelixFragment win =
+      compfrg.window(flxfrg.timestamp(450), flxfrg.timestamp(900));
+  BOOST_REQUIRE_EQUAL(win.total_frames(), 450u);
+  BOOST_CHECK_EQUAL(win.timestamp(0), flxfrg.timestamp(450));
+
+  // Compact headers combine with compressed ADCs, and both restore the
+  // original frames.
+  artdaq::Fragment both = dune::FelixCompactHeaders(
+      dune::FelixEncode(raw, dune::ReorderedFelixFrames::adc_block_for));
+  for (const artdaq::Fragment* f : {&compact, &both}) {
+    artdaq::Fragment restored = dune::FelixRestore(*f);
+    BOOST_REQUIRE_EQUAL(restored.dataSizeBytes(), frag.dataSizeBytes());
+    BOOST_CHECK(std::equal(bytes, bytes + frag.dataSizeBytes(),
+                           restored.dataBeginBytes()));
+  }
+
+  // Compact headers cannot be changed in place.
+  dune::ReorderedFelixFrames* compact_frames =
+      reinterpret_cast<dune::ReorderedFelixFrames*>(compact.dataBeginBytes());
+  BOOST_CHECK_THROW(compact_frames->set_timestamp(3, 0), cet::exception);
+  BOOST_CHECK_THROW(compact_frames->set_s1_error(3, 1, 0), cet::exception);
+  BOOST_CHECK(compfrg.timestamp(3) == flxfrg.timestamp(3));
+
+  // Readers accept version 2 fragments but reject newer versions and
+  // unknown encodings.
+  typedef dune::ReorderedFelixFrames::Header Header;
+  Header* head = reinterpret_cast<Header*>(both.dataBeginBytes());
+  BOOST_CHECK(head->version == dune::ReorderedFelixFrames::format_version);
+  head->version = 2;
+  BOOST_CHECK_NO_THROW(dune::FelixFragment(both, 1));
+  head->version = dune::ReorderedFelixFrames::format_version + 1;
+  BOOST_CHECK_THROW(dune::FelixFragment(both, 1), cet::exception);
+  BOOST_CHECK_THROW(dune::FelixRestore(both), cet::exception);
+  head->version = dune::ReorderedFelixFrames::format_version;
+  head->header_encoding = 2;
+  BOOST_CHECK_THROW(dune::FelixFragment(both, 1), cet::exception);
+  head->header_encoding = dune::ReorderedFelixFrames::headers_compact;
+  head->adc_encoding = 4;
+  BOOST_CHECK_THROW(dune::FelixFragment(both, 1), cet::exception);
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(ResyncTest) {
+  std::cout << "### MEOW -> Testing frame re-synchronization...\n";
+
+  const size_t frames = 200;
+  const size_t fs = sizeof(dune::FelixFrame);
+  std::vector<dune::FelixFrame> frm(frames);
+  uint8_t* bytes = reinterpret_cast<uint8_t*>(frm.data());
+  std::srand(73);
+  for (size_t i = 0; i < frames * fs; ++i) bytes[i] = std::rand() & 0xff;
+  for (size_t i = 0; i < frames; ++i) {
+    frm[i].set_sof(0x3c);
+    frm[i].set_version(3);
+    frm[i].set_fiber_no(1);
+    frm[i].set_crate_no(5);
+    frm[i].set_slot_no(2);
+    frm[i].set_timestamp(1000 + 25 * i);
+  }
+
+  // Frame 20 is cut short, 37 stray bytes precede frame 80, the header of
+  // frame 120 is damaged and the stream ends in a partial frame.
+  std::vector<uint8_t> stream;
+  std::vector<size_t> kept;
+  std::vector<size_t> broke;
+  for (size_t i = 0; i < frames; ++i) {
+    const uint8_t* f = bytes + i * fs;
+    if (i == 20) {
+      broke.push_back(stream.size());
+      stream.insert(stream.end(), f, f + 200);
+      continue;
+    }
+    if (i == 80) {
+      broke.push_back(stream.size());
+      for (int k = 0; k < 37; ++k) stream.push_back(std::rand() & 0xff);
+    }
+    stream.insert(stream.end(), f, f + fs);
+    if (i == 120) {
+      broke.push_back(stream.size() - fs);
+      stream[stream.size() - fs] ^= 0xff;
+      continue;
+    }
+    kept.push_back(i);
+  }
+  broke.push_back(stream.size());
+  stream.insert(stream.end(), bytes, bytes + 100);
+
+  const dune::FelixFrameScanner scanner(frm[0]);
+  const dune::FelixFrameTable table =
+      scanner.scan(stream.data(), stream.size());
+  BOOST_CHECK(!table.aligned());
+  BOOST_REQUIRE_EQUAL(table.offsets.size(), kept.size());
+  BOOST_REQUIRE_EQUAL(table.gaps.size(), broke.size());
+  for (size_t g = 0; g < broke.size(); ++g) {
+    BOOST_CHECK_EQUAL(table.gaps[g].begin, broke[g]);
+    const dune::FelixResyncGap& gap = table.gaps[g];
+    BOOST_CHECK_EQUAL(gap.end, gap.next_frame < table.offsets.size()
+                                   ? table.offsets[gap.next_frame]
+                                   : stream.size());
+  }
+  // Matching on sof and version only finds the same frames.
+  BOOST_CHECK(dune::FelixFrameScanner(0x3c, 3)
+                  .scan(stream.data(), stream.size())
+                  .offsets == table.offsets);
+  // A reordered fragment holds no frames to scan.
+  artdaq::Fragment reord = dune::FelixReorder(bytes, frames);
+  BOOST_CHECK_THROW(scanner.scan(dune::FelixFragment(reord, 1)),
+                    cet::exception);
+
+  // The overlay follows the table.
+  const dune::FelixFragment flxfrg(stream.data(), stream.size(),
+                                   table.offsets);
+  BOOST_CHECK(!flxfrg.contiguous());
+  BOOST_REQUIRE_EQUAL(flxfrg.total_frames(), kept.size());
+  for (size_t i = 0; i < kept.size(); ++i) {
+    BOOST_REQUIRE_EQUAL(flxfrg.timestamp(i), frm[kept[i]].timestamp());
+    BOOST_REQUIRE_EQUAL(flxfrg.get_ADC(i, 99), frm[kept[i]].channel(99));
+  }
+  std::vector<dune::FelixFrame> good;
+  for (size_t i : kept) good.push_back(frm[i]);
+  const dune::FelixFragment goodfrg(good.data(), good.size() * fs);
+  dune::adc_v expected(256 * kept.size()), decoded(256 * kept.size());
+  goodfrg.decode_all(expected.data(), kept.size());
+  flxfrg.decode_all(decoded.data(), kept.size());
+  BOOST_CHECK(decoded == expected);
+  BOOST_CHECK(dune::gather_timestamps(flxfrg) ==
+              dune::gather_timestamps(goodfrg));
+  BOOST_CHECK(dune::validate_checksums(flxfrg).count() ==
+              dune::validate_checksums(goodfrg).count());
+
+  const dune::FelixFragment win =
+      flxfrg.window(frm[70].timestamp(), frm[130].timestamp());
+  BOOST_REQUIRE_EQUAL(win.total_frames(), 59u);
+  BOOST_CHECK_EQUAL(win.timestamp(0), frm[70].timestamp());
+  BOOST_CHECK_EQUAL(win.get_ADC(58, 7), frm[129].channel(7));
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(TimestampSortTest) {
+  std::cout << "### MEOW -> Testing sorting of frames by timestamp...\n";
+
+  // Edge cases and wide keys against a stable sort.
+  std::srand(79);
+  for (size_t n : {0, 1, 2, 5, 1000}) {
+    std::vector<uint64_t> t(n);
+    for (auto& v : t) v = (uint64_t(std::rand()) << 31 | std::rand()) % 50;
+    if (n == 1000) t[7] = 0x7fffffffffffffffULL;
+    std::vector<size_t> expected(n);
+    std::iota(expected.begin(), expected.end(), size_t(0));
+    std::stable_sort(expected.begin(), expected.end(),
+                     [&](size_t a, size_t b) { return t[a] < t[b]; });
+    BOOST_REQUIRE(dune::timestamp_order(t.data(), n) == expected);
+  }
+
+  // DMA blocks of 64 frames delivered out of order, with some duplicated
+  // timestamps.
+  const size_t frames = 3000;
+  const size_t fs = sizeof(dune::FelixFrame);
+  std::vector<dune::FelixFrame> frm(frames);
+  uint8_t* bytes = reinterpret_cast<uint8_t*>(frm.data());
+  for (size_t i = 0; i < frames * fs; ++i) bytes[i] = std::rand() & 0xff;
+  std::vector<size_t> block(frames / 64 + 1);
+  std::iota(block.begin(), block.end(), size_t(0));
+  for (size_t i = block.size() - 1; i > 0; --i) {
+    std::swap(block[i], block[std::rand() % (i + 1)]);
+  }
+  for (size_t i = 0; i < frames; ++i) {
+    frm[i].set_z(0);
+    const size_t tick = block[i / 64] * 64 + i % 64;
+    frm[i].set_timestamp(0x1234567800ULL + 25 * (tick - tick % 3 / 2));
+  }
+  std::vector<uint64_t> ts(frames);
+  for (size_t i = 0; i < frames; ++i) ts[i] = frm[i].timestamp();
+  BOOST_CHECK(!dune::timestamps_sorted(ts.data(), frames));
+  std::vector<size_t> expected(frames);
+  std::iota(expected.begin(), expected.end(), size_t(0));
+  std::stable_sort(expected.begin(), expected.end(),
+                   [&](size_t a, size_t b) { return ts[a] < ts[b]; });
+
+  const dune::FelixFragment flxfrg(frm.data(), frames * fs);
+  BOOST_REQUIRE(dune::timestamp_order(flxfrg) == expected);
+
+  // A frame table presents the frames in time order without moving them.
+  const std::vector<size_t> offsets = dune::time_ordered_offsets(flxfrg);
+  const dune::FelixFragment sorted(frm.data(), frames * fs, offsets);
+  const std::vector<uint64_t> sorted_ts = dune::gather_timestamps(sorted);
+  BOOST_CHECK(dune::timestamps_sorted(sorted_ts.data(), frames));
+  for (size_t i = 0; i < frames; i += 11) {
+    BOOST_REQUIRE_EQUAL(sorted.get_ADC(i, 200),
+                        frm[expected[i]].channel(200));
+  }
+  // Reordered fragments have no frames to point at.
+  artdaq::Fragment reord = dune::FelixReorder(bytes, frames);
+  BOOST_CHECK_THROW(dune::time_ordered_offsets(dune::FelixFragment(reord, 1)),
+                    cet::exception);
+
+  // Sorting in place gives the frames in the same order.
+  std::vector<dune::FelixFrame> copy(frm);
+  dune::sort_frames_by_timestamp(copy.data(), frames);
+  for (size_t i = 0; i < frames; ++i) {
+    BOOST_REQUIRE(memcmp(&copy[i], &frm[expected[i]], fs) == 0);
+  }
+  const dune::FelixFragment copyfrg(copy.data(), frames * fs);
+  const std::vector<size_t> identity = dune::timestamp_order(copyfrg);
+  BOOST_CHECK(std::is_sorted(identity.begin(), identity.end()));
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
+BOOST_AUTO_TEST_CASE(DispatchTest) {
+  std::cout << "### MEOW -> Testing layout dispatch of FelixFragment...\n";
+
+  // The same random frames through the unordered and the reordered overlay,
+  // both directly and through the FelixFragmentBase interface.
+  const size_t frames = 300;
+  artdaq::Fragment frag;
+  frag.resizeBytes(frames * sizeof(dune::FelixFrame));
+  std::srand(83);
+  for (size_t i = 0; i < frag.dataSizeBytes(); ++i) {
+    frag.dataBeginBytes()[i] = std::rand() & 0xff;
+  }
+  artdaq::Fragment reord = dune::FelixReorder(frag.dataBeginBytes(), frames);
+  const dune::FelixFragment unordfrg(frag);
+  const dune::FelixFragment reordfrg(reord, 1);
+  const dune::FelixFragmentBase& u = unordfrg;
+  const dune::FelixFragmentBase& r = reordfrg;
+
+  BOOST_CHECK(!unordfrg.reordered());
+  BOOST_CHECK(reordfrg.reordered());
+  BOOST_CHECK(unordfrg.contiguous());
+  BOOST_CHECK(!reordfrg.contiguous());
+  BOOST_REQUIRE_EQUAL(unordfrg.total_frames(), frames);
+  BOOST_REQUIRE_EQUAL(reordfrg.total_frames(), frames);
+  BOOST_CHECK_EQUAL(u.total_frames(), r.total_frames());
+  BOOST_CHECK_EQUAL(unordfrg.total_adc_values(), reordfrg.total_adc_values());
+
+  for (unsigned i = 0; i < frames; ++i) {
+    BOOST_REQUIRE_EQUAL(unordfrg.sof(i), reordfrg.sof(i));
+    BOOST_REQUIRE_EQUAL(unordfrg.version(i), reordfrg.version(i));
+    BOOST_REQUIRE_EQUAL(unordfrg.fiber_no(i), reordfrg.fiber_no(i));
+    BOOST_REQUIRE_EQUAL(unordfrg.slot_no(i), reordfrg.slot_no(i));
+    BOOST_REQUIRE_EQUAL(unordfrg.crate_no(i), reordfrg.crate_no(i));
+    BOOST_REQUIRE_EQUAL(unordfrg.mm(i), reordfrg.mm(i));
+    BOOST_REQUIRE_EQUAL(unordfrg.oos(i), reordfrg.oos(i));
+    BOOST_REQUIRE_EQUAL(unordfrg.wib_errors(i), reordfrg.wib_errors(i));
+    BOOST_REQUIRE_EQUAL(unordfrg.timestamp(i), reordfrg.timestamp(i));
+    BOOST_REQUIRE_EQUAL(unordfrg.wib_counter(i), reordfrg.wib_counter(i));
+    BOOST_REQUIRE_EQUAL(unordfrg.CRC32(i), reordfrg.CRC32(i));
+    BOOST_REQUIRE_EQUAL(u.timestamp(i), r.timestamp(i));
+    BOOST_REQUIRE_EQUAL(u.CRC32(i), r.CRC32(i));
+    for (unsigned b = 0; b < 4; ++b) {
+      BOOST_REQUIRE_EQUAL(unordfrg.s1_error(i, b), reordfrg.s1_error(i, b));
+      BOOST_REQUIRE_EQUAL(unordfrg.s2_error(i, b), reordfrg.s2_error(i, b));
+      BOOST_REQUIRE_EQUAL(unordfrg.checksum_a(i, b),
+                          reordfrg.checksum_a(i, b));
+      BOOST_REQUIRE_EQUAL(unordfrg.checksum_b(i, b),
+                          reordfrg.checksum_b(i, b));
+      BOOST_REQUIRE_EQUAL(unordfrg.coldata_convert_count(i, b),
+                          reordfrg.coldata_convert_count(i, b));
+      BOOST_REQUIRE_EQUAL(unordfrg.error_register(i, b),
+                          reordfrg.error_register(i, b));
+      for (unsigned h = 1; h <= 8; ++h) {
+        BOOST_REQUIRE_EQUAL(unordfrg.hdr(i, b, h), reordfrg.hdr(i, b, h));
+      }
+      BOOST_REQUIRE_EQUAL(u.checksum_a(i, b), r.checksum_a(i, b));
+      for (unsigned ch = 0; ch < 64; ++ch) {
+        BOOST_REQUIRE_EQUAL(unordfrg.get_ADC(i, b, ch),
+                            reordfrg.get_ADC(i, b, ch));
+      }
+    }
+    for (unsigned ch = 0; ch < 256; ++ch) {
+      BOOST_REQUIRE_EQUAL(unordfrg.get_ADC(i, ch), reordfrg.get_ADC(i, ch));
+      BOOST_REQUIRE_EQUAL(u.get_ADC(i, ch), r.get_ADC(i, ch));
+    }
+  }
+
+  // Bulk accessors.
+  for (unsigned ch = 0; ch < 256; ++ch) {
+    BOOST_REQUIRE(unordfrg.get_ADCs_by_channel(ch) ==
+                  reordfrg.get_ADCs_by_channel(ch));
+    BOOST_REQUIRE(unordfrg.get_ADCs_by_channel(ch / 64, ch % 64) ==
+                  reordfrg.get_ADCs_by_channel(ch / 64, ch % 64));
+    BOOST_REQUIRE(u.get_ADCs_by_channel(ch) == r.get_ADCs_by_channel(ch));
+  }
+  BOOST_CHECK(unordfrg.get_all_ADCs() == reordfrg.get_all_ADCs());
+  dune::adc_v unord_all(256 * frames), reord_all(256 * frames);
+  u.decode_all(unord_all.data(), frames);
+  r.decode_all(reord_all.data(), frames);
+  BOOST_CHECK(unord_all == reord_all);
+  dune::adc_v unord_rows(256 * frames, 0), reord_rows(256 * frames, 0);
+  std::vector<dune::adc_t*> urows(256), rrows(256);
+  for (unsigned ch = 0; ch < 256; ch += 2) {
+    urows[ch] = unord_rows.data() + ch * frames;
+    rrows[ch] = reord_rows.data() + ch * frames;
+  }
+  unordfrg.decode_rows(urows.data());
+  reordfrg.decode_rows(rrows.data());
+  BOOST_CHECK(unord_rows == reord_rows);
+
+  // Views keep the layout of the fragment they come from.
+  const dune::FelixFragment uview = unordfrg.frame_range(100, 50);
+  const dune::FelixFragment rview = reordfrg.frame_range(100, 50);
+  BOOST_CHECK(!uview.reordered());
+  BOOST_CHECK(rview.reordered());
+  BOOST_CHECK_EQUAL(rview.first_frame(), 100u);
+  BOOST_REQUIRE_EQUAL(rview.total_frames(), 50u);
+  for (unsigned i = 0; i < 50; ++i) {
+    BOOST_REQUIRE_EQUAL(uview.timestamp(i), rview.timestamp(i));
+    BOOST_REQUIRE_EQUAL(uview.get_ADC(i, 133), rview.get_ADC(i, 133));
+  }
+
+  std::cout << "### MEOW -> Tests successful.\n";
+}
+
 #if 0
 BOOST_AUTO_TEST_CASE(TinyBufferTest)
 {
@@ -0,0 +1,6 @@
+// Second translation unit of DUNE_FelixFragment_t. The FELIX overlays are
+// header only, so including them here as well makes the test fail to link
+// if one of them defines a non-inline function.
+#define FELIX_UNVERIFIED_CHECKSUMS
+#include "dune-raw-data/Overlays/FelixApa.hh"
+#include "dune-raw-data/Overlays/FelixChecksum.hh"